@@ -22,54 +22,300 @@
 #define _GNU_SOURCE
 
 #include "applet.h"
+#include "brightnessservice.h"
 #include "displaymanager.h"
+#include "probes.h"
+#include "slidervalue.h"
+#include "topology.h"
 #include <stdlib.h>
 #include <glib/gi18n-lib.h>
 
+/* seconds after startup, when discovery starts without any interaction */
+#define LAZY_DISCOVERY_DELAY 30
+
+/* while a brightness key is held or the wheel turns, values are sent at most this often (ms) */
+#define GROUP_FLUSH_INTERVAL 50
+
+/* one wheel step changes brightness this much */
+#define SCROLL_STEP 7
+
+/* hovering the icon reads the monitors again at most this often (ms) */
+#define PREWARM_INTERVAL 3000
+
+/* confirmed values are written to the cache this long after the last change (seconds) */
+#define SAVE_DELAY 5
+
+/* monitors, that were plugged in, get this long to answer ddc before they are searched (seconds) */
+#define REDISCOVERY_DELAY 2
+
+/* userdata of create_brightness_popover, that makes it look for the monitors again */
+#define RECREATE_REDISCOVER 1   /* monitors were plugged in or out, the buses are searched again */
+#define RECREATE_REQUERY 2      /* the helper was restarted, it is only asked for its monitors */
+
 static char tooltip_text[5];
 static int displaycount = 0;
 static GtkWidget *ebox, *popover, *sliderbox;
-static BudgiePopoverManager *managerref;
 
-typedef struct Brightness_Store{
-	gpointer range;
-	int value;
-} Brightness_Store;
+/* internal display, ddc displays and gamma dimmed outputs */
+#define MAX_DISPLAYS (1 + MAX_DDC_DISPLAYS + MAX_GAMMA_DISPLAYS)
+
+/* marks an empty incoming slot */
+#define NO_VALUE G_MININT
+
+/* everything the applet keeps per display */
+typedef struct Display_Slider {
+	Display_Id id;                  /* display shown by this slider, DISPLAY_ID_NONE if unused */
+	GtkWidget *box;                 /* separator, label and scale, NULL if unused */
+	GtkWidget *separator;           /* only shown, if another slider comes first */
+	GtkWidget *label;               /* shows if a monitor does not answer */
+	GtkWidget *scale;
+	gboolean value_known;           /* scale shows a value of the monitor or the user, not just 0 */
+	Slider_Value outgoing;          /* slider value not sent to the backend yet */
+	guint tick_id;                  /* frame clock callback sending the outgoing value, 0 if none */
+	int group_value;                /* unclamped value of the last group step, NO_VALUE after any other change */
+	gint reading;                   /* a read of the monitor is running, written by any thread */
+	gint64 read_started;            /* monotonic time of the last read, its result loses against newer user changes */
+	gint64 changed_at;              /* monotonic time of the last user change */
+	gint incoming_value;            /* latest brightness from the backend, written by any thread */
+	gint incoming_degraded;         /* latest degraded state from the backend, written by any thread */
+	gboolean provisional;           /* restored from the cache, user values wait until discovery confirms the display */
+} Display_Slider;
+
+/* fixed size, so worker threads can always write into it, a slider keeps its slot while its display exists */
+static Display_Slider sliders[MAX_DISPLAYS];
+/* slots of the shown sliders from left to right */
+static int order[MAX_DISPLAYS];
+static GtkWidget *no_display_label = NULL;
+
+/**
+ * returns the slot of the slider of a display, -1 if the id is stale
+ * any thread may call this
+ */
+static int slot_of(Display_Id id)
+{
+	for (int i = 0; i < MAX_DISPLAYS; i++)
+		if (sliders[i].id == id && id != DISPLAY_ID_NONE)
+			return i;
+	return -1;
+}
+
+/* applies incoming values in the main loop, woken up by g_source_set_ready_time */
+static GSource *delivery_source = NULL;
+
+static BudgiePopoverManager *managerref;
+static gboolean discovery_started = FALSE;
+static gboolean discovery_running = FALSE;
+static gpointer recreate_pending = NULL;  /* recreation, that waits for the running discovery */
+static guint discovery_timeout = 0;
+static guint rediscovery_timeout = 0;
+static gint64 discovery_start_time = 0;
+static guint group_flush_id = 0;
+static gint64 last_prewarm = 0;
+static guint save_id = 0;
 
 G_DEFINE_DYNAMIC_TYPE_EXTENDED(MonitorBrightnessApplet, monitor_brightness_applet, BUDGIE_TYPE_APPLET, 0, )
 
-static gboolean refresh_range(gpointer user_data)
+static void start_discovery();
+static gboolean create_brightness_popover(gpointer userdata);
+static void change_brightness(GtkWidget *scale, void *v);
+
+/**
+ * lowest value of the scale of a slider
+ */
+static int minimum_of(int i)
+{
+	return gtk_adjustment_get_lower(gtk_range_get_adjustment(GTK_RANGE(sliders[i].scale)));
+}
+
+/**
+ * shows a value, that did not come from the user, change_brightness would send it to the monitor
+ */
+static void show_value(int i, int value)
+{
+	g_signal_handlers_block_by_func(sliders[i].scale, change_brightness, (void*) ((intptr_t)i));
+	gtk_range_set_value(GTK_RANGE(sliders[i].scale), value);
+	g_signal_handlers_unblock_by_func(sliders[i].scale, change_brightness, (void*) ((intptr_t)i));
+}
+
+/**
+ * stores the sliders with their last confirmed values, so the next start can show them right away
+ * nothing is stored before discovery confirmed the restored sliders
+ */
+static void save_sliders()
 {
-	Brightness_Store *store = user_data;
+	Topology_Slider entries[MAX_DISPLAYS];
 	
-	GtkRange *range = store -> range;
-	int value = store -> value;
+	for (int n = 0; n < displaycount; n++) {
+		Display_Slider *slider = &sliders[order[n]];
+		if (slider -> provisional)
+			return;
+		
+		entries[n].id = slider -> id;
+		entries[n].minimum = minimum_of(order[n]);
+		entries[n].brightness = slider -> value_known ? (int) gtk_range_get_value(GTK_RANGE(slider -> scale)) : BRIGHTNESS_UNKNOWN;
+		g_strlcpy(entries[n].name, gtk_label_get_text(GTK_LABEL(slider -> label)), TOPOLOGY_NAME_SIZE);
+	}
 	
-	gtk_range_set_value(GTK_RANGE(range), value);
+	topology_write_sliders(entries, displaycount);
+}
+
+static gboolean save_timeout(gpointer user_data)
+{
+	save_id = 0;
+	save_sliders();
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * saves the sliders a bit later, so a drag or a key held down writes only once
+ */
+static void schedule_save()
+{
+	if (save_id == 0)
+		save_id = g_timeout_add_seconds(SAVE_DELAY, save_timeout, NULL);
+}
+
+/**
+ * greys out the name of a monitor, that does not answer
+ */
+static void show_degraded(int dispnum, gboolean degraded)
+{
+	if (sliders[dispnum].label == NULL)
+		return;
 	
-	/* frees Brightness_Store */
-	g_free(store);
+	gtk_widget_set_sensitive(sliders[dispnum].label, !degraded);
+	gtk_widget_set_tooltip_text(sliders[dispnum].label, degraded ? _("Monitor does not respond") : NULL);
+}
+
+/**
+ * applies everything, that came in from the backend since the last main loop iteration
+ */
+static gboolean deliver_results(gpointer user_data)
+{
+	for (int i = 0; i < MAX_DISPLAYS; i++) {
+		Display_Slider *slider = &sliders[i];
+		
+		int value = g_atomic_int_get(&slider -> incoming_value);
+		if (value != NO_VALUE && g_atomic_int_compare_and_exchange(&slider -> incoming_value, value, NO_VALUE)) {
+			if (value != BRIGHTNESS_UNKNOWN && slider -> scale != NULL && slider -> changed_at <= slider -> read_started) {
+				show_value(i, value);
+				slider -> value_known = TRUE;
+				slider -> group_value = NO_VALUE;
+				schedule_save();
+			}
+		}
+		
+		int degraded = g_atomic_int_get(&slider -> incoming_degraded);
+		if (degraded != NO_VALUE && g_atomic_int_compare_and_exchange(&slider -> incoming_degraded, degraded, NO_VALUE))
+			show_degraded(i, degraded);
+	}
 	
-	return G_SOURCE_REMOVE;
+	return G_SOURCE_CONTINUE;
+}
+
+/**
+ * clears the ready time before applying, so values arriving meanwhile wake it up again
+ */
+static gboolean delivery_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+	g_source_set_ready_time(source, -1);
+	return callback(user_data);
+}
+
+static GSourceFuncs delivery_funcs = { NULL, NULL, delivery_dispatch, NULL };
+
+/**
+ * wakes up the main loop once, no matter how many values arrive
+ */
+static void schedule_delivery()
+{
+	g_source_set_ready_time(delivery_source, 0);
 }
 
-static void update_brightness(int brightness, void* range)
+static void update_brightness(int brightness, void* id)
 {
-	/* store values for main-loop-thread */
-	Brightness_Store *store = g_malloc(sizeof(Brightness_Store));
-	store -> range = range;
-	store -> value = brightness;
+	/* answers for displays, that are gone meanwhile, are dropped */
+	int i = slot_of((Display_Id) (uintptr_t) id);
+	if (i < 0)
+		return;
+	
+	g_atomic_int_set(&sliders[i].reading, 0);
 	
-	/* run in main thread */
-	gdk_threads_add_idle(refresh_range, store);
+	/* latest value wins, no allocation and at most one dispatch per main loop iteration */
+	g_atomic_int_set(&sliders[i].incoming_value, brightness);
+	schedule_delivery();
 }
 
-static void update_brightness_from_proxy_signal(int brightness, void *range) {
-    if (!gtk_widget_get_visible(popover))
-        update_brightness(brightness, range);
+static void update_brightness_from_proxy_signal(int brightness, void *id) {
+    if (!gtk_widget_get_visible(popover)) {
+        /* the signal tells the current value, it is newer than any change before */
+        int i = slot_of((Display_Id) (uintptr_t) id);
+        if (i >= 0)
+            sliders[i].read_started = g_get_monotonic_time();
+        update_brightness(brightness, id);
+    }
         
 }
 
+static void update_degraded(Display_Id id, int degraded)
+{
+	int i = slot_of(id);
+	if (i < 0)
+		return;
+	
+	g_atomic_int_set(&sliders[i].incoming_degraded, degraded ? 1 : 0);
+	schedule_delivery();
+}
+
+/**
+ * sends the pending slider value of a display to the backend
+ */
+static void flush_slider(int i)
+{
+	Display_Slider *slider = &sliders[i];
+	
+	if (slider -> tick_id != 0) {
+		gtk_widget_remove_tick_callback(slider -> scale, slider -> tick_id);
+		slider -> tick_id = 0;
+	}
+	
+	/* the backend does not know a restored display yet, the latest value waits for it */
+	if (slider_value_flush(&slider -> outgoing, slider -> id, slider -> provisional, set_brightness_percentage))
+		schedule_save();
+}
+
+/**
+ * sends all pending slider values
+ */
+static void flush_all_sliders()
+{
+	for (int i = 0; i < MAX_DISPLAYS; i++)
+		if (sliders[i].scale != NULL)
+			flush_slider(i);
+}
+
+/**
+ * nothing may stay pending, when the popover closes
+ */
+static void on_popover_hide(GtkWidget *widget, gpointer userdata)
+{
+	flush_all_sliders();
+}
+
+/**
+ * runs once per frame while a slider moves, so the backend gets at most one value per frame
+ */
+static gboolean slider_tick(GtkWidget *scale, GdkFrameClock *clock, gpointer v)
+{
+	intptr_t i = (intptr_t)v;
+	
+	/* removed by returning G_SOURCE_REMOVE */
+	sliders[i].tick_id = 0;
+	flush_slider(i);
+	
+	return G_SOURCE_REMOVE;
+}
+
 /**
  * changes brightness of single monitor
  */
@@ -81,69 +327,426 @@ static void change_brightness(GtkWidget *scale, void *v)
 	/* set brightness of scale */
 	int val = gtk_range_get_value(GTK_RANGE(scale));
 	/* prevents double emitting signals  */
-	if (gtk_widget_get_visible(popover))
-	    set_brightness_percentage(i, val);
+	if (gtk_widget_get_visible(popover)) {
+	    unsigned int trace_id = probe_new_id();
+	    PROBE(slider_changed, trace_id, sliders[i].id, val);
+	    
+	    /* a fast drag emits far more values than monitors can take, only keep the latest until the next frame */
+	    sliders[i].value_known = TRUE;
+	    sliders[i].group_value = NO_VALUE;
+	    sliders[i].changed_at = g_get_monotonic_time();
+	    if (slider_value_change(&sliders[i].outgoing, val, trace_id))
+	        sliders[i].tick_id = gtk_widget_add_tick_callback(scale, slider_tick, v, NULL);
+	}
 }
 
+/**
+ * sends what key repeat or the wheel collected meanwhile, ends when they stop
+ */
+static gboolean group_flush_timeout(gpointer user_data)
+{
+	gboolean pending = FALSE;
+	for (int i = 0; i < MAX_DISPLAYS; i++)
+		if (sliders[i].scale != NULL && slider_value_pending(&sliders[i].outgoing) && !sliders[i].provisional)
+			pending = TRUE;
+	
+	if (!pending) {
+		group_flush_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+	
+	flush_all_sliders();
+	return G_SOURCE_CONTINUE;
+}
 
 /**
- * creates and adds GtkWidgets that depend on the thread
+ * moves a slider like the user would, the value is sent with the next flush
  */
-static gboolean create_sliders(gpointer user_data)
+static void move_slider(int i, int value, unsigned int trace_id)
 {
-	if (displaycount > 0) {
-		/* add sliderbox for every display */	
-		GtkWidget *sliderboxes[displaycount];
+	sliders[i].value_known = TRUE;
+	sliders[i].group_value = NO_VALUE;
+	sliders[i].changed_at = g_get_monotonic_time();
+	if (slider_value_change(&sliders[i].outgoing, value, trace_id))
+		sliders[i].tick_id = gtk_widget_add_tick_callback(sliders[i].scale, slider_tick, (void*) ((intptr_t)i), NULL);
+	show_value(i, value);
+	
+	if (i == order[0]) {
+		sprintf(tooltip_text, "%d%%", value);
+		gtk_widget_set_tooltip_text(ebox, tooltip_text);
+	}
+}
 
-		for (int i = 0; i < displaycount; i++) {
+/**
+ * changes every display relative to its own value, so the offsets between monitors stay
+ * a display is only sent a value, if it really changes. With LINKED_OFFSETS a clamped
+ * display remembers how far it is off, so it gets its offset back on the way back.
+ * The first step is sent at once, following ones are batched.
+ */
+static void step_group(int delta, gboolean scrolled)
+{
+	start_discovery();
+	
+	for (int i = 0; i < MAX_DISPLAYS; i++) {
+		/* a step from a value nobody read yet would set a made up brightness */
+		if (sliders[i].scale == NULL || !sliders[i].value_known)
+			continue;
 		
-			/* Add Separator between Sliders, if more than one monitor avaliable */
-			if (i != 0) {
-				GtkWidget *sep = gtk_separator_new(GTK_ORIENTATION_VERTICAL);
-				gtk_box_pack_start(GTK_BOX(sliderbox), sep, FALSE, FALSE, 4);
+		int old = gtk_range_get_value(GTK_RANGE(sliders[i].scale));
+		int wanted = old + delta;
+#ifdef LINKED_OFFSETS
+		if (sliders[i].group_value != NO_VALUE)
+			wanted = CLAMP(sliders[i].group_value + delta, -100, 200);
+#endif
+		int value = CLAMP(wanted, minimum_of(i), 100);
+		
+		if (value != old) {
+			unsigned int trace_id = probe_new_id();
+			if (scrolled) {
+				PROBE(scroll_changed, trace_id, sliders[i].id, value);
+			} else {
+				PROBE(key_changed, trace_id, sliders[i].id, value);
 			}
+			move_slider(i, value, trace_id);
+		}
+		
+		/* after move_slider, which forgets it */
+		sliders[i].group_value = wanted;
+	}
+	
+	if (group_flush_id == 0) {
+		flush_all_sliders();
+		group_flush_id = g_timeout_add(GROUP_FLUSH_INTERVAL, group_flush_timeout, NULL);
+	}
+}
+
+/**
+ * called for brightness keys
+ */
+static void step_brightness(int delta)
+{
+	step_group(delta, FALSE);
+}
+
+/**
+ * number of displays for the command line client, 0 until the sliders exist
+ */
+static int service_count()
+{
+	start_discovery();
+	return displaycount;
+}
+
+static const char *service_get_name(int n)
+{
+	/* the label holds the name of restored displays as well */
+	return gtk_label_get_text(GTK_LABEL(sliders[order[n]].label));
+}
+
+/**
+ * the value shown by the slider, the client does not wait for a monitor
+ */
+static int service_get_value(int n)
+{
+	int i = order[n];
+	if (!sliders[i].value_known)
+		return -1;
+	/* gamma dimming below the minimum is still 0 for the client */
+	return MAX(0, gtk_range_get_value(GTK_RANGE(sliders[i].scale)));
+}
+
+static void service_set_value(int n, int value)
+{
+	int i = order[n];
+	unsigned int trace_id = probe_new_id();
+	PROBE(slider_changed, trace_id, sliders[i].id, value);
+	move_slider(i, value, trace_id);
+	flush_slider(i);
+}
+
+static const Service_Callbacks service_callbacks = {
+	step_brightness,
+	service_count,
+	service_get_name,
+	service_get_value,
+	service_set_value
+};
+
+/**
+ * the final value of a drag is sent at once
+ */
+static gboolean release_slider(GtkWidget *scale, GdkEventButton *buttonevent, void *v)
+{
+	flush_slider((intptr_t)v);
+	return GDK_EVENT_PROPAGATE;
+}
+
+
+/**
+ * creates the widgets of a display in a free slot, the backend is not asked for anything
+ */
+static int build_slider(Display_Id id, const char *dspname, int minimum)
+{
+	int i = 0;
+	while (i < MAX_DISPLAYS - 1 && sliders[i].box != NULL)
+		i++;
+	
+	/* separator and sliderbox, the separator is only shown for the second and following sliders */
+	GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+	GtkWidget *sep = gtk_separator_new(GTK_ORIENTATION_VERTICAL);
+	gtk_box_pack_start(GTK_BOX(box), sep, FALSE, FALSE, 4);
+	
+	/* create sliderbox */
+	GtkWidget *innerbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+	
+	GtkWidget *label = gtk_label_new(dspname);
+	
+	/* create scale */
+	/* monitors dimmed by gamma below their minimum go below 0 */
+	GtkWidget *scale = gtk_scale_new_with_range(GTK_ORIENTATION_VERTICAL, minimum, 100, 1);
+	gtk_range_set_inverted(GTK_RANGE(scale), TRUE);
+	
+	sliders[i].box = box;
+	sliders[i].separator = sep;
+	sliders[i].label = label;
+	sliders[i].scale = scale;
+	sliders[i].value_known = FALSE;
+	slider_value_init(&sliders[i].outgoing);
+	sliders[i].tick_id = 0;
+	sliders[i].group_value = NO_VALUE;
+	sliders[i].reading = 0;
+	sliders[i].read_started = 0;
+	sliders[i].changed_at = 0;
+	sliders[i].provisional = FALSE;
+	g_atomic_int_set(&sliders[i].incoming_value, NO_VALUE);
+	g_atomic_int_set(&sliders[i].incoming_degraded, NO_VALUE);
+	/* last, so answers can only arrive for a complete slider */
+	sliders[i].id = id;
+	
+	/* make scale look prettier */
+	gtk_scale_set_draw_value(GTK_SCALE(scale), FALSE);
+	gtk_widget_set_size_request(scale, 25, 120);
+	
+	/* the slot stays the same as long as the slider exists */
+	g_signal_connect(scale, "value-changed", G_CALLBACK(change_brightness), (void*) ((intptr_t)i));
+	g_signal_connect(scale, "button-release-event", G_CALLBACK(release_slider), (void*) ((intptr_t)i));
+	
+	/* add label and scale to sliderbox */
+	gtk_box_pack_start(GTK_BOX(innerbox), label, FALSE, FALSE, 5);
+	gtk_box_pack_start(GTK_BOX(innerbox), scale, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(box), innerbox, TRUE, FALSE, 5);
+	
+	/* add sliderbox to outer sliderbox */
+	gtk_box_pack_start(GTK_BOX(sliderbox), box, TRUE, FALSE, 0);
+	gtk_widget_show_all(box);
+	
+	return i;
+}
+
+/**
+ * connects a slider to the backend, reads its value unless the user changed it meanwhile
+ */
+static void attach_slider(int i)
+{
+	Display_Id id = sliders[i].id;
+	
+	if (!slider_value_pending(&sliders[i].outgoing)) {
+		/* get value for range (this is handled in an thread to avoid lag) */
+		sliders[i].reading = 1;
+		sliders[i].read_started = g_get_monotonic_time();
+		get_brightness_percentage(id, (void*) ((uintptr_t)id), update_brightness);
+	}
+	
+	/* tell displaymanager scale, so value can be connected */
+	register_scale((void*) ((uintptr_t)id), id, update_brightness_from_proxy_signal);
+	
+	show_degraded(i, is_degraded(id));
+}
+
+/**
+ * creates the widgets of a new display in a free slot and starts reading its value
+ */
+static int add_slider(Display_Id id)
+{
+	char name[DISPLAY_NAME_SIZE];
+	if (get_display_name(id, name, sizeof(name)) != 0)
+		name[0] = '\0';
+	
+	int i = build_slider(id, name, get_minimum_brightness(id));
+	attach_slider(i);
+	return i;
+}
+
+/**
+ * a restored slider belongs to a display of the discovery, the value, that the user set meanwhile, is sent
+ */
+static void confirm_slider(int i)
+{
+	sliders[i].provisional = FALSE;
+	gtk_style_context_remove_class(gtk_widget_get_style_context(sliders[i].label), "dim-label");
+	gtk_widget_set_tooltip_text(sliders[i].label, NULL);
+	gtk_range_set_range(GTK_RANGE(sliders[i].scale), get_minimum_brightness(sliders[i].id), 100);
+	
+	attach_slider(i);
+	flush_slider(i);
+}
+
+/**
+ * shows the sliders of the last run, until discovery confirms or removes them
+ */
+static void restore_sliders()
+{
+	Topology_Slider entries[MAX_DISPLAYS];
+	int count = topology_read_sliders(entries, MAX_DISPLAYS);
+	
+	for (int n = 0; n < count; n++) {
+		if (entries[n].id == DISPLAY_ID_NONE || slot_of(entries[n].id) >= 0)
+			continue;
 		
-			/* create sliderbox */
-			sliderboxes[i] = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-			
-			/* get name of display */
-			char *dspname = get_display_name(i);
-			GtkWidget *label = gtk_label_new(dspname);
-			
-			/* create scale */
-			GtkWidget *scale = gtk_scale_new_with_range(GTK_ORIENTATION_VERTICAL, 0, 100, 1);
-			gtk_range_set_inverted(GTK_RANGE(scale), TRUE);
-			
-			/* get value for range (this is handled in an thread to avoid lag) */
-			get_brightness_percentage(i, scale, update_brightness);
-			
-			/* make scale look prettier */
-			gtk_scale_set_draw_value(GTK_SCALE(scale), FALSE);
-			gtk_widget_set_size_request(scale, 25, 120);
-			
-		    /* dirty, but fast + prevents mistakes with memory management */
-		    g_signal_connect(scale, "value-changed", G_CALLBACK(change_brightness), (void*) ((intptr_t)i));
-			
-			/* add label and scale to sliderbox */
-			gtk_box_pack_start(GTK_BOX(sliderboxes[i]), label, FALSE, FALSE, 5);
-			gtk_box_pack_start(GTK_BOX(sliderboxes[i]), scale, FALSE, FALSE, 0);
-			
-			/* add sliderbox to outer sliderbox */
-			gtk_box_pack_start(GTK_BOX(sliderbox), sliderboxes[i], TRUE, FALSE, 5);
-			
-			/* tell displaymanager scale, so value can be connected */
-			register_scale(scale, i, update_brightness_from_proxy_signal);
+		int i = build_slider(entries[n].id, entries[n].name, entries[n].minimum);
+		sliders[i].provisional = TRUE;
+		gtk_style_context_add_class(gtk_widget_get_style_context(sliders[i].label), "dim-label");
+		gtk_widget_set_tooltip_text(sliders[i].label, _("Searching for this monitor"));
+		if (entries[n].brightness != BRIGHTNESS_UNKNOWN) {
+			show_value(i, entries[n].brightness);
+			sliders[i].value_known = TRUE;
+		}
+		
+		order[displaycount] = i;
+		gtk_widget_set_visible(sliders[i].separator, displaycount != 0);
+		displaycount++;
+	}
+}
 
+/**
+ * destroys the widgets of a display, that is gone, late answers for it are dropped
+ */
+static void remove_slider(int i)
+{
+	flush_slider(i);
+	
+	sliders[i].id = DISPLAY_ID_NONE;
+	/* destroying the widgets removes their tick callback */
+	gtk_widget_destroy(sliders[i].box);
+	sliders[i].box = NULL;
+	sliders[i].separator = NULL;
+	sliders[i].label = NULL;
+	sliders[i].scale = NULL;
+	sliders[i].tick_id = 0;
+	sliders[i].value_known = FALSE;
+	sliders[i].provisional = FALSE;
+}
+
+/**
+ * tells, if id is one of the first count ids
+ */
+static gboolean contains_id(Display_Id *ids, int count, Display_Id id)
+{
+	for (int n = 0; n < count; n++)
+		if (ids[n] == id)
+			return TRUE;
+	return FALSE;
+}
+
+/**
+ * tells, if id belongs to a ddc display, whose generation is made from its edid
+ */
+static gboolean is_ddc_id(Display_Id id)
+{
+	return id != DISPLAY_ID_NONE && DISPLAY_ID_SLOT(id) < MAX_DDC_DISPLAYS;
+}
+
+/**
+ * tells, if two ids are of the same kind, whose generation is made from the edid or the output name
+ */
+static gboolean is_same_kind(Display_Id a, Display_Id b)
+{
+	return (is_ddc_id(a) && is_ddc_id(b)) || (DISPLAY_ID_IS_GAMMA(a) && DISPLAY_ID_IS_GAMMA(b));
+}
+
+/**
+ * finds the id of a restored monitor, that discovery put into another slot
+ * returns DISPLAY_ID_NONE, if none of the first count ids has the same identity and no slider yet
+ */
+static Display_Id find_moved(Display_Id *ids, int count, Display_Id id)
+{
+	for (int n = 0; n < count; n++)
+		if (is_same_kind(ids[n], id) && DISPLAY_ID_GENERATION(ids[n]) == DISPLAY_ID_GENERATION(id) && slot_of(ids[n]) < 0)
+			return ids[n];
+	return DISPLAY_ID_NONE;
+}
+
+/**
+ * brings the sliders in line with the displays found by discovery
+ * sliders of displays, that stay, keep their widgets and state, only new displays are read
+ */
+static gboolean create_sliders(gpointer user_data)
+{
+	int found = GPOINTER_TO_INT(user_data);
+	Display_Id ids[MAX_DISPLAYS];
+	int count = 0;
+	
+	for (int n = 0; n < found; n++) {
+		Display_Id id = get_display_id(n);
+		if (id != DISPLAY_ID_NONE && !contains_id(ids, count, id))
+			ids[count++] = id;
+	}
+	
+	/* ids carry the edid or the output name, a restored monitor in another slot keeps its slider and pending value */
+	for (int i = 0; i < MAX_DISPLAYS; i++) {
+		if (sliders[i].box == NULL || !sliders[i].provisional || contains_id(ids, count, sliders[i].id))
+			continue;
+		Display_Id moved = find_moved(ids, count, sliders[i].id);
+		if (moved != DISPLAY_ID_NONE)
+			sliders[i].id = moved;
+	}
+	
+	/* an id of another monitor or output in the same slot differs, so sliders of ids, that are still there, show the same one */
+	for (int i = 0; i < MAX_DISPLAYS; i++)
+		if (sliders[i].box != NULL && !contains_id(ids, count, sliders[i].id))
+			remove_slider(i);
+	
+	for (int n = 0; n < count; n++) {
+		int i = slot_of(ids[n]);
+		if (i < 0)
+			i = add_slider(ids[n]);
+		else if (sliders[i].provisional)
+			confirm_slider(i);
+		
+		order[n] = i;
+		gtk_box_reorder_child(GTK_BOX(sliderbox), sliders[i].box, n);
+		gtk_widget_set_visible(sliders[i].separator, n != 0);
+	}
+	displaycount = count;
+	
+	if (count > 0) {
+		if (no_display_label != NULL) {
+			gtk_widget_destroy(no_display_label);
+			no_display_label = NULL;
 		}
-	} else {
-		GtkWidget *no_display_label = gtk_label_new(_("No supported monitors found"));
+		
+		/* tell, when a monitor stops answering */
+		register_state_callback(update_degraded);
+	} else if (no_display_label == NULL) {
+		no_display_label = gtk_label_new(_("No supported monitors found"));
 		gtk_box_pack_start(GTK_BOX(sliderbox), no_display_label, FALSE, FALSE, 5);
+		gtk_widget_show(no_display_label);
 	}
 	
-	/* Show all of our things. */
-        gtk_widget_show_all(GTK_WIDGET(sliderbox));
-        
-        return G_SOURCE_REMOVE;
+	g_debug("Sliders usable %" G_GINT64_FORMAT " ms after discovery started",
+	        (g_get_monotonic_time() - discovery_start_time) / 1000);
+	
+	/* the next start shows exactly these sliders */
+	schedule_save();
+	
+	/* monitors changed, while they were searched */
+	discovery_running = FALSE;
+	if (recreate_pending != NULL) {
+		gdk_threads_add_idle(create_brightness_popover, recreate_pending);
+		recreate_pending = NULL;
+	}
+	
+	return G_SOURCE_REMOVE;
 }
 
 /** 
@@ -151,11 +754,61 @@ static gboolean create_sliders(gpointer user_data)
  */
 static void update_displaycount(int count) 
 {	
-	/* get displaycount */
-	displaycount = count;
+	/* run in main thread, displaycount changes there */
+	gdk_threads_add_idle(create_sliders, GINT_TO_POINTER(count < MAX_DISPLAYS ? count : MAX_DISPLAYS));
+}
+
+/**
+ * starts discovery of displays, if it did not run yet
+ */
+static void start_discovery()
+{
+	if (discovery_started)
+		return;
+	discovery_started = TRUE;
+	
+	if (discovery_timeout != 0) {
+		g_source_remove(discovery_timeout);
+		discovery_timeout = 0;
+	}
 	
-	/* run in main thread */
-	gdk_threads_add_idle(create_sliders, NULL);
+	discovery_running = TRUE;
+	discovery_start_time = g_get_monotonic_time();
+	count_displays_and_init(update_displaycount);
+}
+
+/**
+ * starts discovery, if nobody interacted with the applet after startup
+ */
+static gboolean discovery_timeout_reached(gpointer userdata)
+{
+	discovery_timeout = 0;
+	start_discovery();
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * monitors were plugged in or out, they are searched, when they settled
+ */
+static gboolean rediscovery_timeout_reached(gpointer userdata)
+{
+	rediscovery_timeout = 0;
+	return create_brightness_popover(GINT_TO_POINTER(RECREATE_REDISCOVER));
+}
+
+static void on_monitors_changed(GdkScreen *screen, gpointer userdata)
+{
+	if (rediscovery_timeout != 0)
+		g_source_remove(rediscovery_timeout);
+	rediscovery_timeout = g_timeout_add_seconds(REDISCOVERY_DELAY, rediscovery_timeout_reached, NULL);
+}
+
+/**
+ * the helper was restarted, called from another thread
+ */
+static void on_displays_changed()
+{
+	gdk_threads_add_idle(create_brightness_popover, GINT_TO_POINTER(RECREATE_REQUERY));
 }
 
 /**
@@ -163,13 +816,14 @@ static void update_displaycount(int count)
  */
 static gboolean create_brightness_popover(gpointer userdata) 
 {
-	/* if userdata != NULL -> recreate, this can be used later, when ddcutil is able to reinitialize */
+	/* if userdata != NULL -> recreate, it is RECREATE_REDISCOVER or RECREATE_REQUERY */
 	if (userdata == NULL) {
 	
 		GtkWidget *mainbox, *sep1, *nightlightbox, *nightlightlabel, *nightlightswitch;
 	
 		/* create budgie popover if it does not exist */
 		popover = budgie_popover_new(ebox);
+		g_signal_connect(popover, "hide", G_CALLBACK(on_popover_hide), NULL);
 		
 		/* create box inside of popover */
 		mainbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
@@ -205,17 +859,37 @@ static gboolean create_brightness_popover(gpointer userdata)
 		gtk_widget_show_all(GTK_WIDGET(mainbox));
 	
 	} else {
-		/* remove all inner containers */
-		/*GList *children, *iter;
-		children = gtk_container_get_children(GTK_CONTAINER(sliderbox));
-		//for(iter = children; iter != NULL; iter = g_list_next(iter))
-		//	gtk_widget_destroy(GTK_WIDGET(iter->data));
-		g_list_free_full(children, gtk_widget_destroy);*/
+		/* the first discovery sees the current monitors anyway */
+		if (!discovery_started)
+			return G_SOURCE_REMOVE;
+		
+		/* one discovery at a time, a search of the buses wins over asking the helper */
+		if (discovery_running) {
+			if (recreate_pending != GINT_TO_POINTER(RECREATE_REDISCOVER))
+				recreate_pending = userdata;
+			return G_SOURCE_REMOVE;
+		}
+		
+		if (GPOINTER_TO_INT(userdata) == RECREATE_REDISCOVER)
+			rediscover_displays();
+		
+		/* sliders stay, create_sliders only changes what differs after discovery */
+		flush_all_sliders();
 		
-		gtk_container_foreach (GTK_CONTAINER (sliderbox), (GtkCallback) gtk_widget_destroy, NULL);
+		/* rediscover right away */
+		discovery_started = FALSE;
 	}
+	
+#ifdef LAZY_DISCOVERY
+	/* do not compete with session startup, discovery starts on first interaction */
+	if (userdata == NULL) {
+		discovery_timeout = g_timeout_add_seconds_full(G_PRIORITY_LOW, LAZY_DISCOVERY_DELAY,
+		                                               discovery_timeout_reached, NULL, NULL);
+		return G_SOURCE_REMOVE;
+	}
+#endif
 		
-	count_displays_and_init(update_displaycount);
+	start_discovery();
 	
 	///* Display Settings */
 	//GtkWidget *sep2 = gtk_separator_new(GTK_ORIENTATION_HORIZONTAL);
@@ -238,58 +912,50 @@ static gboolean create_brightness_popover(gpointer userdata)
  */
 static void on_scroll_event(GtkWidget *image, GdkEventScroll *scroll)
 {
-	/* return if there is no monitor here */
-	if (displaycount == 0)
-		return;
-		
-	
-	/* Collect ranges */
-	GtkRange *ranges[displaycount];
-	int countnum = 0;
-	GList *sliderboxes = gtk_container_get_children(GTK_CONTAINER(sliderbox));
-	for (GList *item = sliderboxes; item != NULL; item = item -> next) {
-		/* skip separator */
-		if (GTK_IS_CONTAINER(item -> data)) {
-			GList *inner = gtk_container_get_children(GTK_CONTAINER(item -> data));
-			for (GList *inneritem = inner; inneritem != NULL; inneritem = inneritem -> next) {
-				/* skip label */
-				if (GTK_IS_RANGE(inneritem -> data))
-					ranges[countnum++] = GTK_RANGE(inneritem -> data);
-			}
-			
-			g_list_free(inner);
-		}
-	}
-	
-	g_list_free(sliderboxes);
-	
-	int value = gtk_range_get_value(ranges[0]);
-	
-	/* raise or lower birghtness */
-	if (scroll -> direction == GDK_SCROLL_UP) {
-		value += 7;
-	} else if (scroll -> direction == GDK_SCROLL_DOWN) {
-		value -= 7;
-	}
+	/* raise or lower brightness of every monitor */
+	if (scroll -> direction == GDK_SCROLL_UP)
+		step_group(SCROLL_STEP, TRUE);
+	else if (scroll -> direction == GDK_SCROLL_DOWN)
+		step_group(-SCROLL_STEP, TRUE);
+	else
+		start_discovery();
+}
+
+/**
+ * reads every monitor again in the background, so the popover opens with fresh values
+ * all reads run in parallel, monitors with a read in flight or an unsent value are left out
+ */
+static void prewarm_values()
+{
+	gint64 now = g_get_monotonic_time();
 	
-	/* limit value */
-	if (value > 100)
-		value = 100;
-	else if (value < 0)
-		value = 0;
+	/* sliders read their values on creation, fly-overs must not flood the buses */
+	if (displaycount == 0 || now - last_prewarm < PREWARM_INTERVAL * 1000)
+		return;
+	last_prewarm = now;
 	
-	/* set new brightness for every scale */
-	for (int i = 0; i < displaycount; i++) {
-		gtk_range_set_value(ranges[i], value);
+	for (int i = 0; i < MAX_DISPLAYS; i++) {
+		Display_Slider *slider = &sliders[i];
+		
+		/* the internal display tells changes by itself */
+		if (slider -> scale == NULL || slider -> provisional || is_self_updated(slider -> id) || slider_value_pending(&slider -> outgoing))
+			continue;
+		if (!g_atomic_int_compare_and_exchange(&slider -> reading, 0, 1))
+			continue;
+		
+		slider -> read_started = now;
+		prefetch_brightness_percentage(slider -> id, (void*) ((uintptr_t) slider -> id), update_brightness);
 	}
-	
-	/* set value to all screens */
-	set_brightness_percentage_for_all(value);	
+}
 
-	/* store value of first scrollbar in tooltip_text-array */
-	sprintf(tooltip_text, "%d%%", value);
-	gtk_widget_set_tooltip_text(image, tooltip_text);
-	
+/**
+ * Pointer enters the icon, likely the user wants to change brightness soon
+ */
+static gboolean on_enter_event(GtkWidget *image, GdkEventCrossing *crossingevent)
+{
+	start_discovery();
+	prewarm_values();
+	return GDK_EVENT_PROPAGATE;
 }
 
 /**
@@ -303,6 +969,8 @@ static void on_press_event(GtkWidget *image, GdkEventButton *buttonevent)
 		return;
 	}
 	
+	start_discovery();
+	
 	/* Hide if already showing */
 	if (gtk_widget_get_visible(popover)) {
 		gtk_widget_hide(popover);
@@ -324,12 +992,33 @@ static void monitor_brightness_applet_init(MonitorBrightnessApplet *self)
     gtk_container_add(GTK_CONTAINER(ebox), image);
             
     /* Connect EventBox to its signals */
-	gtk_widget_set_events(ebox, GDK_SCROLL_MASK | GDK_BUTTON_PRESS_MASK);
+	gtk_widget_set_events(ebox, GDK_SCROLL_MASK | GDK_BUTTON_PRESS_MASK | GDK_ENTER_NOTIFY_MASK);
 	g_signal_connect(ebox, "scroll_event", G_CALLBACK(on_scroll_event), NULL);
 	g_signal_connect(ebox, "button_press_event", G_CALLBACK(on_press_event), NULL);
+	g_signal_connect(ebox, "enter_notify_event", G_CALLBACK(on_enter_event), NULL);
+	
+	/* results of worker threads are applied here */
+	for (int i = 0; i < MAX_DISPLAYS; i++) {
+		sliders[i].incoming_value = NO_VALUE;
+		sliders[i].incoming_degraded = NO_VALUE;
+	}
+	delivery_source = g_source_new(&delivery_funcs, sizeof(GSource));
+	g_source_set_priority(delivery_source, G_PRIORITY_DEFAULT_IDLE);
+	g_source_set_callback(delivery_source, deliver_results, NULL, NULL);
+	g_source_attach(delivery_source, NULL);
 	
 	/* Create Popover */
 	create_brightness_popover(NULL);
+	
+	/* the popover is usable before discovery finishes */
+	restore_sliders();
+	
+	/* brightness keys and the command line client use this */
+	service_init(&service_callbacks);
+	
+	/* look for monitors again, when they are plugged in or out or the helper was restarted */
+	g_signal_connect(gdk_screen_get_default(), "monitors-changed", G_CALLBACK(on_monitors_changed), NULL);
+	register_displays_callback(on_displays_changed);
         
 	/* Add ebox to applet */
     gtk_container_add(GTK_CONTAINER(self), ebox);
@@ -353,8 +1042,39 @@ static void update_popovers(BudgieApplet *self, BudgiePopoverManager *manager)
 static void monitor_brightness_applet_dispose(GObject *object)
 {
     G_OBJECT_CLASS(monitor_brightness_applet_parent_class)->dispose(object);
+    
+    if (discovery_timeout != 0) {
+        g_source_remove(discovery_timeout);
+        discovery_timeout = 0;
+    }
+    
+    g_signal_handlers_disconnect_by_func(gdk_screen_get_default(), on_monitors_changed, NULL);
+    if (rediscovery_timeout != 0) {
+        g_source_remove(rediscovery_timeout);
+        rediscovery_timeout = 0;
+    }
+    
+    if (group_flush_id != 0) {
+        g_source_remove(group_flush_id);
+        group_flush_id = 0;
+    }
+    
+    /* values of the last seconds are not lost */
+    if (save_id != 0) {
+        g_source_remove(save_id);
+        save_id = 0;
+        save_sliders();
+    }
+    service_destroy();
+    
     /* this should clear everything from the heap */
     clear_all();
+    
+    if (delivery_source != NULL) {
+        g_source_destroy(delivery_source);
+        g_source_unref(delivery_source);
+        delivery_source = NULL;
+    }
 }
 
 
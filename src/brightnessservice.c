@@ -0,0 +1,206 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <gio/gio.h>
+
+#include "brightnessservice.h"
+
+/* change of StepUp and StepDown in percent */
+#define KEY_STEP 5
+
+static const gchar introspection_xml[] =
+    "<node>"
+    "  <interface name='" SERVICE_NAME "'>"
+    "    <method name='StepUp'/>"
+    "    <method name='StepDown'/>"
+    "    <method name='Step'>"
+    "      <arg type='i' name='delta' direction='in'/>"
+    "    </method>"
+    "    <method name='List'>"
+    "      <arg type='a(si)' name='displays' direction='out'/>"
+    "    </method>"
+    "    <method name='Set'>"
+    "      <arg type='i' name='display' direction='in'/>"
+    "      <arg type='i' name='value' direction='in'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+
+static guint owner_id = 0;
+static guint registration_id = 0;
+static GDBusConnection *bus = NULL;
+static GDBusNodeInfo *introspection_data = NULL;
+static const Service_Callbacks *applet = NULL;
+
+/**
+ * answers with name and last known value of every display, nothing waits for a monitor
+ */
+static void handle_list(GDBusMethodInvocation *invocation)
+{
+    GVariantBuilder builder;
+    int count = applet -> count();
+    
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(si)"));
+    for (int i = 0; i < count; i++) {
+        const char *name = applet -> get_name(i);
+        g_variant_builder_add(&builder, "(si)", name != NULL ? name : "", applet -> get_value(i));
+    }
+    
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(a(si))", &builder));
+}
+
+/**
+ * sets one display or all of them, if display is -1
+ */
+static void handle_set(GDBusMethodInvocation *invocation, GVariant *parameters)
+{
+    int display, value;
+    int count = applet -> count();
+    
+    g_variant_get(parameters, "(ii)", &display, &value);
+    if (display < -1 || display >= count || value < 0 || value > 100) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "No display %d or value %d out of range", display, value);
+        return;
+    }
+    
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    
+    for (int i = 0; i < count; i++)
+        if (display == -1 || display == i)
+            applet -> set_value(i, value);
+}
+
+/**
+ * handles method calls, they arrive in the main thread
+ */
+static void handle_method_call(GDBusConnection       *connection,
+                               const gchar           *sender,
+                               const gchar           *object_path,
+                               const gchar           *interface_name,
+                               const gchar           *method_name,
+                               GVariant              *parameters,
+                               GDBusMethodInvocation *invocation,
+                               gpointer               user_data)
+{
+    int delta = 0;
+    
+    if (g_strcmp0(method_name, "List") == 0) {
+        handle_list(invocation);
+        return;
+    }
+    if (g_strcmp0(method_name, "Set") == 0) {
+        handle_set(invocation, parameters);
+        return;
+    }
+    
+    if (g_strcmp0(method_name, "StepUp") == 0)
+        delta = KEY_STEP;
+    else if (g_strcmp0(method_name, "StepDown") == 0)
+        delta = -KEY_STEP;
+    else if (g_strcmp0(method_name, "Step") == 0)
+        g_variant_get(parameters, "(i)", &delta);
+    
+    /* answer first, key repeat should not wait for the monitors */
+    g_dbus_method_invocation_return_value(invocation, NULL);
+    
+    if (delta != 0)
+        applet -> step(delta);
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+    handle_method_call,
+    NULL,
+    NULL
+};
+
+/**
+ * exports the object, as soon as the bus is there
+ */
+static void on_bus_acquired(GDBusConnection *connection, const gchar *name, gpointer user_data)
+{
+    GError *error = NULL;
+    
+    registration_id = g_dbus_connection_register_object(connection,
+                                                        SERVICE_PATH,
+                                                        introspection_data -> interfaces[0],
+                                                        &interface_vtable,
+                                                        NULL,
+                                                        NULL,
+                                                        &error);
+    if (registration_id == 0) {
+        g_printerr("Error exporting brightness service: %s\n", error -> message);
+        g_error_free(error);
+    } else {
+        bus = g_object_ref(connection);
+    }
+}
+
+/**
+ * another applet owns the name already, it gets the keys
+ */
+static void on_name_lost(GDBusConnection *connection, const gchar *name, gpointer user_data)
+{
+    if (connection != NULL)
+        g_debug("%s is owned by another applet", name);
+}
+
+/**
+ * exports the applet on the session bus, so brightness keys and the command line client can use it
+ */
+void service_init(const Service_Callbacks *callbacks)
+{
+    if (owner_id != 0)
+        return;
+    
+    applet = callbacks;
+    introspection_data = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+    owner_id = g_bus_own_name(G_BUS_TYPE_SESSION,
+                              SERVICE_NAME,
+                              G_BUS_NAME_OWNER_FLAGS_NONE,
+                              on_bus_acquired,
+                              NULL,
+                              on_name_lost,
+                              NULL,
+                              NULL);
+}
+
+/**
+ * removes the applet from the session bus
+ */
+void service_destroy()
+{
+    if (owner_id == 0)
+        return;
+    
+    if (registration_id != 0) {
+        g_dbus_connection_unregister_object(bus, registration_id);
+        g_object_unref(bus);
+        bus = NULL;
+        registration_id = 0;
+    }
+    
+    g_bus_unown_name(owner_id);
+    owner_id = 0;
+    applet = NULL;
+    
+    g_dbus_node_info_unref(introspection_data);
+    introspection_data = NULL;
+}
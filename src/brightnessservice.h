@@ -0,0 +1,44 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+/* where the applet is found on the session bus, also used by the command line client */
+#define SERVICE_NAME "com.github.do_sch.MonitorBrightness"
+#define SERVICE_PATH "/com/github/do_sch/MonitorBrightness"
+
+/* what the service asks the applet for, everything is called in the main thread */
+typedef struct Service_Callbacks {
+    void (*step)(int delta);            /* relative change of all displays in percent */
+    int (*count)();                     /* number of displays, starts discovery */
+    const char *(*get_name)(int n);
+    int (*get_value)(int n);            /* last known value, -1 if there is none */
+    void (*set_value)(int n, int value);
+} Service_Callbacks;
+
+/**
+ * exports the applet on the session bus, so brightness keys and the command line client can use it
+ */
+void service_init(const Service_Callbacks *callbacks);
+
+/**
+ * removes the applet from the session bus
+ */
+void service_destroy();
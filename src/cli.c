@@ -0,0 +1,144 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * budgie-monitor-brightness
+ *
+ *   budgie-monitor-brightness list
+ *   budgie-monitor-brightness get [DISPLAY]
+ *   budgie-monitor-brightness set [DISPLAY] VALUE
+ *
+ * Asks the running applet over the session bus, it answers from its sliders
+ * without waiting for a monitor. Without applet, the helper runs the command
+ * on the monitors directly (see standalone.h), so only it loads libddcutil.
+ */
+
+#include <errno.h>
+#include <gio/gio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "brightnessservice.h"
+#include "clicommand.h"
+
+#ifndef HELPER_PATH
+#define HELPER_PATH "budgie-monitor-brightness-helper"
+#endif
+
+/* the applet discovers displays on the first request, it gets this long (ms) */
+#define DISCOVERY_WAIT_MS 5000
+#define DISCOVERY_POLL_MS 100
+
+/**
+ * calls a method of the applet, returns NULL and sets error on failure
+ */
+static GVariant *call_applet(GDBusConnection *bus, const char *method, GVariant *parameters, GError **error)
+{
+	return g_dbus_connection_call_sync(bus, SERVICE_NAME, SERVICE_PATH, SERVICE_NAME,
+	                                   method, parameters, NULL,
+	                                   G_DBUS_CALL_FLAGS_NO_AUTO_START, 1000, NULL, error);
+}
+
+/**
+ * runs the command by the running applet
+ * returns 0 on success, -1 if there is no applet and error code otherwise
+ */
+static int run_applet(GDBusConnection *bus, Command command, int display, int value)
+{
+	GError *error = NULL;
+	GVariant *result;
+
+	/* the first request after login starts discovery in the applet */
+	int waited = 0;
+	while ((result = call_applet(bus, "List", NULL, &error)) != NULL && waited < DISCOVERY_WAIT_MS) {
+		GVariant *list = g_variant_get_child_value(result, 0);
+		gsize count = g_variant_n_children(list);
+		g_variant_unref(list);
+		if (count > 0)
+			break;
+
+		g_variant_unref(result);
+		usleep(DISCOVERY_POLL_MS * 1000);
+		waited += DISCOVERY_POLL_MS;
+	}
+
+	if (result != NULL && command == COMMAND_SET) {
+		g_variant_unref(result);
+		result = call_applet(bus, "Set", g_variant_new("(ii)", display, value), &error);
+	}
+
+	if (result == NULL) {
+		int missing = g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN) ||
+		              g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_NAME_HAS_NO_OWNER);
+		if (!missing)
+			fprintf(stderr, "Error asking the applet: %s\n", error -> message);
+		g_error_free(error);
+		return missing ? -1 : 1;
+	}
+
+	if (command != COMMAND_SET) {
+		GVariantIter *iter;
+		const char *name;
+		int current, n = 0, found = 0;
+
+		g_variant_get(result, "(a(si))", &iter);
+		while (g_variant_iter_loop(iter, "(&si)", &name, &current)) {
+			if (display == -1 || display == n) {
+				print_display(command, n, name, current);
+				found = 1;
+			}
+			n++;
+		}
+		g_variant_iter_free(iter);
+
+		if (!found) {
+			fprintf(stderr, "No display %d\n", display);
+			g_variant_unref(result);
+			return 1;
+		}
+	}
+
+	g_variant_unref(result);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	Command command;
+	int display, value, status;
+
+	if ((status = parse_command(argc, argv, &command, &display, &value)) != 0)
+		return status;
+
+	GDBusConnection *bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	if (bus != NULL) {
+		status = run_applet(bus, command, display, value);
+		g_object_unref(bus);
+		if (status != -1)
+			return status;
+	}
+
+	/* the helper takes the same arguments */
+	argv[0] = HELPER_PATH;
+	execv(HELPER_PATH, argv);
+	fprintf(stderr, "Error starting %s: %s\n", HELPER_PATH, strerror(errno));
+	return 1;
+}
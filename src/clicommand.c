@@ -0,0 +1,99 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clicommand.h"
+
+/**
+ * prints how to use this
+ */
+static int usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s list\n"
+	                "       %s get [DISPLAY]\n"
+	                "       %s set [DISPLAY] VALUE\n"
+	                "DISPLAY is the number shown by list, without it all displays are used.\n",
+	                name, name, name);
+	return 2;
+}
+
+/**
+ * parses a number, returns 0 on success
+ */
+static int parse_number(const char *text, int *number)
+{
+	char *end;
+	long value = strtol(text, &end, 10);
+
+	if (end == text || *end != '\0' || value < -1 || value > 1000)
+		return -1;
+	*number = value;
+	return 0;
+}
+
+/**
+ * reads the arguments of the command line client, returns 0 on success
+ * otherwise it prints how to use it and returns the exit code
+ */
+int parse_command(int argc, char **argv, Command *command, int *display, int *value)
+{
+	*display = -1;
+	*value = 0;
+
+	if (argc < 2)
+		return usage(argv[0]);
+
+	if (strcmp(argv[1], "list") == 0 && argc == 2) {
+		*command = COMMAND_LIST;
+	} else if (strcmp(argv[1], "get") == 0 && argc <= 3) {
+		*command = COMMAND_GET;
+		if (argc == 3 && (parse_number(argv[2], display) != 0 || *display < 0))
+			return usage(argv[0]);
+	} else if (strcmp(argv[1], "set") == 0 && (argc == 3 || argc == 4)) {
+		*command = COMMAND_SET;
+		if (argc == 4 && (parse_number(argv[2], display) != 0 || *display < 0))
+			return usage(argv[0]);
+		if (parse_number(argv[argc - 1], value) != 0 || *value < 0 || *value > 100)
+			return usage(argv[0]);
+	} else {
+		return usage(argv[0]);
+	}
+	return 0;
+}
+
+/**
+ * prints one display, values below 0 are unknown
+ */
+void print_display(Command command, int n, const char *name, int value)
+{
+	if (command == COMMAND_LIST) {
+		if (value < 0)
+			printf("%d\t%s\t?\n", n, name);
+		else
+			printf("%d\t%s\t%d%%\n", n, name, value);
+	} else if (value < 0) {
+		printf("?\n");
+	} else {
+		printf("%d\n", value);
+	}
+}
@@ -0,0 +1,39 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+/* what the command line client is asked to do */
+typedef enum Command {
+	COMMAND_LIST,
+	COMMAND_GET,
+	COMMAND_SET
+} Command;
+
+/**
+ * reads the arguments of the command line client, returns 0 on success
+ * otherwise it prints how to use it and returns the exit code
+ */
+int parse_command(int argc, char **argv, Command *command, int *display, int *value);
+
+/**
+ * prints one display, values below 0 are unknown
+ */
+void print_display(Command command, int n, const char *name, int value);
@@ -0,0 +1,103 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* a display found by a backend, name and ref stay valid until the backend is freed */
+typedef struct Ddc_Backend_Display {
+	int dispno;
+	int busno;              /* i2c bus, negative if the display is not on one */
+	char *name;
+	uint32_t identity;      /* hash of the edid, the same monitor gets the same one again, 0 if unknown */
+	void *ref;              /* passed to open */
+} Ddc_Backend_Display;
+
+/**
+ * FNV-1a hash of len bytes, backends turn edids into identities with it
+ */
+static inline uint32_t ddc_hash(const void *data, size_t len, uint32_t hash)
+{
+	const uint8_t *bytes = data;
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	return hash;
+}
+
+/* start value of ddc_hash */
+#define DDC_HASH_INIT 2166136261u
+
+/* luminance, the vcp code of the brightness */
+#define BRIGHTNESS_VCP_CODE 0x10
+
+/* the vcp code of the contrast */
+#define CONTRAST_VCP_CODE 0x12
+
+/* a non table vcp value */
+typedef struct Ddc_Value {
+	int current;
+	int max;
+} Ddc_Value;
+
+/**
+ * converts a raw value of the monitor to percent of its maximum, a maximum below 1 counts as 100
+ */
+static inline int ddc_to_percentage(int raw, int max)
+{
+	if (max <= 0)
+		max = 100;
+	return (raw * 100 + max / 2) / max;
+}
+
+/**
+ * converts percent to a raw value of the monitor, a maximum below 1 counts as 100
+ */
+static inline int ddc_to_raw(int percentage, int max)
+{
+	if (max <= 0)
+		max = 100;
+	return (percentage * max + 50) / 100;
+}
+
+/**
+ * the way ddcwrapper talks to monitors, so it does not depend on a ddc library.
+ * Functions return 0 on success or an error code of the backend, that
+ * describe turns into a message. All but discover and free may be called
+ * from several threads, but never twice for the same handle at a time.
+ */
+typedef struct Ddc_Backend {
+	/* stores up to max displays, the number of displays goes to count */
+	int (*discover)(Ddc_Backend_Display *displays, int max, int *count);
+	int (*open)(void *ref, void **handle);
+	int (*close)(void *handle);
+	int (*get)(void *handle, int vcp_code, Ddc_Value *value);
+	int (*set)(void *handle, int vcp_code, int value);
+	const char *(*describe)(int rc);
+	/* tells, if trying again may give another answer */
+	int (*is_transient)(int rc);
+	/* tells, if the backend keeps other processes off the i2c buses itself, otherwise ddcwrapper does */
+	int (*arbitrates_buses)();
+	/* stores the file, whose flock keeps other processes off a bus, may be NULL for /dev/i2c-N */
+	void (*bus_device)(int busno, char *path, size_t size);
+	/* forgets the discovered displays */
+	void (*free)();
+} Ddc_Backend;
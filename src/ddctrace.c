@@ -0,0 +1,408 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ddctrace.h"
+
+/* maximum number of displays a replayed trace can contain */
+#define TRACE_MAX_DISPLAYS 16
+
+/* maximum number of different operation and vcp code pairs replayed per display */
+#define TRACE_MAX_CURSORS 16
+
+/* next record to look at for one operation on one vcp code */
+typedef struct Trace_Cursor {
+	uint8_t op;
+	uint8_t vcp_code;
+	size_t next;
+} Trace_Cursor;
+
+/* a display found in a replayed trace */
+typedef struct Trace_Display {
+	int dispno;
+	char name[TRACE_NAME_SIZE];
+	Trace_Cursor cursors[TRACE_MAX_CURSORS];
+	int cursorcount;
+} Trace_Display;
+
+static int record_fd = -1;
+static uint64_t start_time = 0;
+
+static Trace_Record *records = NULL;
+static size_t recordcount = 0;
+static Trace_Display displays[TRACE_MAX_DISPLAYS];
+static int displaycount = 0;
+
+/* guards writing and replay cursors */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * monotonic time in microseconds
+ */
+static uint64_t monotonic_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * microseconds since recording started
+ */
+uint64_t trace_now_us()
+{
+	return monotonic_us() - start_time;
+}
+
+/**
+ * writes all bytes or prints an error
+ */
+static void write_all(const void *buf, size_t len)
+{
+	if (write(record_fd, buf, len) != (ssize_t) len)
+		perror("Error writing trace");
+}
+
+/**
+ * starts recording into path, returns 0 on success
+ * a restarted helper or the command line client append to the same trace
+ */
+int trace_record_open(const char *path)
+{
+	char header[5] = TRACE_MAGIC;
+	char existing[5];
+	header[4] = TRACE_VERSION;
+
+	record_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (record_fd < 0) {
+		perror("Error opening trace");
+		return -1;
+	}
+
+	start_time = monotonic_us();
+
+	/* only the first process writes the header, the others have to agree with it */
+	ssize_t len = pread(record_fd, existing, sizeof(existing), 0);
+	if (len == 0) {
+		write_all(header, sizeof(header));
+	} else if (len != sizeof(existing) || memcmp(existing, header, sizeof(header)) != 0) {
+		fprintf(stderr, "%s is no trace of version %d, not recording\n", path, TRACE_VERSION);
+		close(record_fd);
+		record_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * returns 1 while recording
+ */
+int trace_is_recording()
+{
+	return record_fd >= 0;
+}
+
+/**
+ * records a discovered display
+ */
+void trace_record_display(int dispno, const char *name)
+{
+	Trace_Record rec = { .op = TRACE_OP_DISPLAY, .dispno = dispno };
+	char namebuf[TRACE_NAME_SIZE] = { 0 };
+
+	if (record_fd < 0)
+		return;
+
+	strncpy(namebuf, name, TRACE_NAME_SIZE - 1);
+
+	/* one write, so records of different threads do not interleave */
+	char buf[sizeof(Trace_Record) + TRACE_NAME_SIZE];
+	memcpy(buf, &rec, sizeof(Trace_Record));
+	memcpy(buf + sizeof(Trace_Record), namebuf, TRACE_NAME_SIZE);
+
+	pthread_mutex_lock(&lock);
+	write_all(buf, sizeof(buf));
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * records one ddc operation
+ */
+void trace_record(Trace_Op op, int dispno, int vcp_code, int value, int max, int rc, uint64_t start_us, uint64_t end_us)
+{
+	Trace_Record rec = {
+		.op = op,
+		.vcp_code = vcp_code,
+		.dispno = dispno,
+		.value = value,
+		.max = max,
+		.rc = rc,
+		.start_us = start_us,
+		.end_us = end_us
+	};
+
+	if (record_fd < 0)
+		return;
+
+	pthread_mutex_lock(&lock);
+	write_all(&rec, sizeof(Trace_Record));
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * loads a trace for replaying, returns 0 on success
+ */
+int trace_replay_open(const char *path)
+{
+	FILE *file;
+	char header[5];
+	Trace_Record rec;
+	size_t capacity = 0;
+
+	if ((file = fopen(path, "rbe")) == NULL) {
+		perror("Error opening trace");
+		return -1;
+	}
+
+	if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+		memcmp(header, TRACE_MAGIC, 4) != 0 || header[4] != TRACE_VERSION) {
+		fprintf(stderr, "%s is no trace of version %d\n", path, TRACE_VERSION);
+		fclose(file);
+		return -1;
+	}
+
+	while (fread(&rec, sizeof(Trace_Record), 1, file) == 1) {
+
+		/* displays are stored separately with their names, every appended run lists them again */
+		if (rec.op == TRACE_OP_DISPLAY) {
+			char name[TRACE_NAME_SIZE];
+			if (fread(name, 1, TRACE_NAME_SIZE, file) != TRACE_NAME_SIZE)
+				break;
+			bool known = false;
+			for (int i = 0; i < displaycount; i++)
+				known |= displays[i].dispno == rec.dispno;
+			if (!known && displaycount < TRACE_MAX_DISPLAYS) {
+				Trace_Display *disp = &displays[displaycount++];
+				memset(disp, 0, sizeof(Trace_Display));
+				disp -> dispno = rec.dispno;
+				memcpy(disp -> name, name, TRACE_NAME_SIZE);
+				disp -> name[TRACE_NAME_SIZE - 1] = '\0';
+			}
+			continue;
+		}
+
+		if (recordcount == capacity) {
+			capacity = capacity == 0 ? 256 : capacity * 2;
+			records = realloc(records, capacity * sizeof(Trace_Record));
+		}
+		records[recordcount++] = rec;
+	}
+
+	fclose(file);
+	return 0;
+}
+
+/**
+ * returns 1 while replaying
+ */
+int trace_is_replaying()
+{
+	return records != NULL || displaycount > 0;
+}
+
+/**
+ * returns the cursor of op and vcp_code for disp, NULL if there are too many
+ */
+static Trace_Cursor *cursor_of(Trace_Display *disp, Trace_Op op, int vcp_code)
+{
+	for (int i = 0; i < disp -> cursorcount; i++)
+		if (disp -> cursors[i].op == op && disp -> cursors[i].vcp_code == vcp_code)
+			return &disp -> cursors[i];
+
+	if (disp -> cursorcount == TRACE_MAX_CURSORS)
+		return NULL;
+
+	Trace_Cursor *cursor = &disp -> cursors[disp -> cursorcount++];
+	cursor -> op = op;
+	cursor -> vcp_code = vcp_code;
+	cursor -> next = 0;
+	return cursor;
+}
+
+/**
+ * finds the next record of op on vcp_code for disp, starts from the beginning if the trace is exhausted
+ */
+static Trace_Record *next_record(Trace_Display *disp, Trace_Op op, int vcp_code)
+{
+	Trace_Cursor *cursor = cursor_of(disp, op, vcp_code);
+	if (cursor == NULL)
+		return NULL;
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = cursor -> next; i < recordcount; i++) {
+			if (records[i].op == op && records[i].vcp_code == vcp_code && records[i].dispno == disp -> dispno) {
+				cursor -> next = i + 1;
+				return &records[i];
+			}
+		}
+		cursor -> next = 0;
+	}
+	return NULL;
+}
+
+/**
+ * replays the next operation op on vcp_code of disp with its recorded duration
+ * returns the recorded return code, value and max may be NULL
+ */
+static int replay_next(Trace_Display *disp, Trace_Op op, int vcp_code, int *value, int *max)
+{
+	Trace_Record rec = { .rc = 0 };
+	Trace_Record *found = NULL;
+
+	pthread_mutex_lock(&lock);
+	found = next_record(disp, op, vcp_code);
+	if (found != NULL)
+		rec = *found;
+	pthread_mutex_unlock(&lock);
+
+	/* operations, that were never recorded, succeed at once */
+	if (found == NULL)
+		return 0;
+
+	if (rec.end_us > rec.start_us)
+		usleep(rec.end_us - rec.start_us);
+
+	if (value != NULL)
+		*value = rec.value;
+	if (max != NULL)
+		*max = rec.max;
+
+	return rec.rc;
+}
+
+/**
+ * hands out the displays of the trace, they are not on any bus
+ */
+static int replay_discover(Ddc_Backend_Display *out, int max, int *count)
+{
+	*count = 0;
+	for (int i = 0; i < displaycount && *count < max; i++, (*count)++) {
+		out[i].dispno = displays[i].dispno;
+		out[i].busno = -1;
+		out[i].name = displays[i].name;
+		/* a trace has no edids, name and dispno tell its displays apart */
+		out[i].identity = ddc_hash(displays[i].name, strlen(displays[i].name),
+		                           ddc_hash(&displays[i].dispno, sizeof(int), DDC_HASH_INIT));
+		out[i].ref = &displays[i];
+	}
+	return 0;
+}
+
+/**
+ * the handle of a replayed display is its Trace_Display
+ */
+static int replay_open(void *ref, void **handle)
+{
+	int rc = replay_next(ref, TRACE_OP_OPEN, 0, NULL, NULL);
+	*handle = rc == 0 ? ref : NULL;
+	return rc;
+}
+
+static int replay_close(void *handle)
+{
+	return replay_next(handle, TRACE_OP_CLOSE, 0, NULL, NULL);
+}
+
+static int replay_get(void *handle, int vcp_code, Ddc_Value *value)
+{
+	value -> current = 0;
+	value -> max = 0;
+	return replay_next(handle, TRACE_OP_GET, vcp_code, &value -> current, &value -> max);
+}
+
+static int replay_set(void *handle, int vcp_code, int value)
+{
+	return replay_next(handle, TRACE_OP_SET, vcp_code, NULL, NULL);
+}
+
+static const char *replay_describe(int rc)
+{
+	return "recorded error";
+}
+
+/**
+ * a replay answers the same way again
+ */
+static int replay_is_transient(int rc)
+{
+	return 0;
+}
+
+/**
+ * a replay does not touch any bus
+ */
+static int replay_arbitrates_buses()
+{
+	return 1;
+}
+
+/**
+ * displays stay until the trace gets closed
+ */
+static void replay_free()
+{
+}
+
+const Ddc_Backend trace_replay_backend = {
+	.discover = replay_discover,
+	.open = replay_open,
+	.close = replay_close,
+	.get = replay_get,
+	.set = replay_set,
+	.describe = replay_describe,
+	.is_transient = replay_is_transient,
+	.arbitrates_buses = replay_arbitrates_buses,
+	.free = replay_free
+};
+
+/**
+ * stops recording or replaying
+ */
+void trace_close()
+{
+	pthread_mutex_lock(&lock);
+	if (record_fd >= 0) {
+		close(record_fd);
+		record_fd = -1;
+	}
+	free(records);
+	records = NULL;
+	recordcount = 0;
+	displaycount = 0;
+	pthread_mutex_unlock(&lock);
+}
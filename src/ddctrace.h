@@ -0,0 +1,102 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "ddcbackend.h"
+
+/* environment variables, that enable recording or replaying in the helper */
+#define TRACE_RECORD_ENV "BUDGIE_BRIGHTNESS_TRACE"
+#define TRACE_REPLAY_ENV "BUDGIE_BRIGHTNESS_REPLAY"
+
+/* file starts with this magic, followed by a version byte */
+#define TRACE_MAGIC "BMBT"
+#define TRACE_VERSION 1
+
+#define TRACE_NAME_SIZE 16
+
+typedef enum Trace_Op {
+	TRACE_OP_DISPLAY = 1,   /* a discovered display, followed by TRACE_NAME_SIZE bytes name */
+	TRACE_OP_OPEN,
+	TRACE_OP_GET,
+	TRACE_OP_SET,
+	TRACE_OP_CLOSE,
+	TRACE_OP_COUNT
+} Trace_Op;
+
+/* one ddc operation, all numbers in host byte order */
+typedef struct __attribute__((packed)) Trace_Record {
+	uint8_t op;
+	uint8_t vcp_code;
+	int16_t dispno;
+	uint16_t value;         /* written or read value */
+	uint16_t max;           /* maximum of read values */
+	int32_t rc;
+	uint64_t start_us;      /* microseconds since the recording process started */
+	uint64_t end_us;
+} Trace_Record;
+
+/**
+ * microseconds since recording started
+ */
+uint64_t trace_now_us();
+
+/**
+ * starts recording into path, returns 0 on success
+ */
+int trace_record_open(const char *path);
+
+/**
+ * returns 1 while recording
+ */
+int trace_is_recording();
+
+/**
+ * records a discovered display
+ */
+void trace_record_display(int dispno, const char *name);
+
+/**
+ * records one ddc operation
+ */
+void trace_record(Trace_Op op, int dispno, int vcp_code, int value, int max, int rc, uint64_t start_us, uint64_t end_us);
+
+/**
+ * loads a trace for replaying, returns 0 on success
+ */
+int trace_replay_open(const char *path);
+
+/**
+ * returns 1 while replaying
+ */
+int trace_is_replaying();
+
+/**
+ * backend, that answers with the displays and operations of the loaded trace
+ * every operation takes as long as it was recorded
+ */
+extern const Ddc_Backend trace_replay_backend;
+
+/**
+ * stops recording or replaying
+ */
+void trace_close();
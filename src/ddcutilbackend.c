@@ -0,0 +1,156 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <ddcutil_c_api.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ddcutilbackend.h"
+
+/* maximum length of a model name (including \0) */
+#define DDCUTIL_NAME_SIZE DDCA_EDID_MODEL_NAME_FIELD_SIZE
+
+/* what is kept of a discovered display, the info list of ddcutil is freed right after discovery */
+typedef struct Ddcutil_Display {
+	DDCA_Display_Ref ref;   /* display refs are persistent in ddcutil and stay valid without the list */
+	char name[DDCUTIL_NAME_SIZE];
+} Ddcutil_Display;
+
+static Ddcutil_Display *records = NULL;
+
+/**
+ * asks ddcutil for all displays, that support ddc
+ */
+static int ddcutil_discover(Ddc_Backend_Display *displays, int max, int *count)
+{
+	DDCA_Status status;
+	DDCA_Display_Info_List *zlist = NULL;
+
+	*count = 0;
+
+	/* higher up ddc retries to ensure every monitor will be found */
+	if ((status = ddca_set_max_tries(DDCA_MULTI_PART_TRIES, 15)) < 0) {
+		fprintf(stderr, "Error setting retries: %d\n", status);
+		return status;
+	}
+
+	if ((status = ddca_get_display_info_list2(true, &zlist)) < 0)
+		return status;
+
+	if (zlist -> ct > max)
+		fprintf(stderr, "Only %d of %d displays are supported\n", max, zlist -> ct);
+
+	free(records);
+	records = calloc(max > 0 ? max : 1, sizeof(Ddcutil_Display));
+	if (records == NULL) {
+		ddca_free_display_info_list(zlist);
+		return -ENOMEM;
+	}
+
+	for (int i = 0; i < zlist -> ct && i < max; i++, (*count)++) {
+		DDCA_Display_Info *info = &(zlist -> info[i]);
+
+		records[i].ref = info -> dref;
+		strncpy(records[i].name, info -> model_name, DDCUTIL_NAME_SIZE - 1);
+
+		displays[i].dispno = info -> dispno;
+		displays[i].busno = info -> path.io_mode == DDCA_IO_I2C ? info -> path.path.i2c_busno : -1;
+		displays[i].name = records[i].name;
+		/* the edid holds manufacturer, model and serial number */
+		displays[i].identity = ddc_hash(info -> edid_bytes, sizeof(info -> edid_bytes), DDC_HASH_INIT);
+		displays[i].ref = &records[i];
+	}
+
+	ddca_free_display_info_list(zlist);
+	return 0;
+}
+
+static int ddcutil_open(void *ref, void **handle)
+{
+	return ddca_open_display2(((Ddcutil_Display*) ref) -> ref, true, (DDCA_Display_Handle*) handle);
+}
+
+static int ddcutil_close(void *handle)
+{
+	return ddca_close_display(handle);
+}
+
+static int ddcutil_get(void *handle, int vcp_code, Ddc_Value *value)
+{
+	DDCA_Non_Table_Vcp_Value val;
+	DDCA_Status rc = ddca_get_non_table_vcp_value(handle, vcp_code, &val);
+
+	if (rc == 0) {
+		value -> current = val.sh << 8 | val.sl;
+		value -> max = val.mh << 8 | val.ml;
+	}
+	return rc;
+}
+
+static int ddcutil_set(void *handle, int vcp_code, int value)
+{
+	return ddca_set_non_table_vcp_value(handle, vcp_code, value >> 8, value & 0xff);
+}
+
+static const char *ddcutil_describe(int rc)
+{
+	return ddca_rc_desc(rc);
+}
+
+/**
+ * garbled or missing answers may be collisions on the bus, unsupported features stay unsupported
+ */
+static int ddcutil_is_transient(int rc)
+{
+	return rc == DDCRC_DDC_DATA || rc == DDCRC_NULL_RESPONSE || rc == DDCRC_READ_ALL_ZERO ||
+	       rc == DDCRC_ALL_RESPONSES_NULL || rc == DDCRC_RETRIES || rc == -EBUSY;
+}
+
+/**
+ * ddcutil 2 takes a flock on /dev/i2c-N while a display is open, a second lock
+ * of ddcwrapper on its own file descriptor would collide with it
+ */
+static int ddcutil_arbitrates_buses()
+{
+	return ddca_ddcutil_version().major >= 2;
+}
+
+/**
+ * frees the records of the discovered displays
+ */
+static void ddcutil_free()
+{
+	free(records);
+	records = NULL;
+}
+
+const Ddc_Backend ddcutil_backend = {
+	.discover = ddcutil_discover,
+	.open = ddcutil_open,
+	.close = ddcutil_close,
+	.get = ddcutil_get,
+	.set = ddcutil_set,
+	.describe = ddcutil_describe,
+	.is_transient = ddcutil_is_transient,
+	.arbitrates_buses = ddcutil_arbitrates_buses,
+	.free = ddcutil_free
+};
@@ -18,36 +18,145 @@
  * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 
-#include <ddcutil_c_api.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "ddctrace.h"
 #include "ddcwrapper.h"
+#include "probes.h"
 
-#define BRIGHTNESS_VCP_CODE 0x10
+/* power mode, 1 is on, everything above is standby, suspend or off */
+#define POWER_MODE_VCP_CODE 0xd6
+#define POWER_MODE_ON 1
+
+/* connectors in sysfs, their dpms file tells without any bus traffic, if a monitor sleeps */
+#define DRM_PATH "/sys/class/drm"
+
+/* a display, whose operation runs longer than this, is degraded */
+#define OP_DEADLINE_MS 2000
+
+/* a degraded display gets probed in this interval */
+#define HEALTH_PROBE_INTERVAL_MS 5000
+
+/* first retry after a failure waits about this long, every further failure doubles it */
+#define BACKOFF_BASE_MS 100
+#define BACKOFF_MAX_MS 30000
+
+/* probes running at the same time during discovery, never more than one per bus */
+#define MAX_PARALLEL_PROBES 4
+
+/* a probe is tried this often, as long as the backend calls its errors transient */
+#define PROBE_ATTEMPTS 3
+
+/* without requests for this long, degraded displays are not probed anymore until the next request */
+#ifndef IDLE_AFTER_MS
+#define IDLE_AFTER_MS 600000
+#endif
+
+/* other processes get this long to give up the flock of a bus, then the transaction goes on without it */
+#define BUS_LOCK_WAIT_MS 1000
+#define BUS_LOCK_POLL_MS 1
+
+/* values read from a monitor answer reads for this long without bus traffic, benchmarks turn it off */
+#ifndef VALUE_CACHE_MS
+#define VALUE_CACHE_MS 5000
+#endif
+
+/* before the system sleeps, workers get this long to finish their operation and park */
+#define SLEEP_QUIESCE_MS 2000
+
+/* a sleeping monitor is checked in this interval, while a brightness waits for it */
+#define POWER_CHECK_INTERVAL_MS 5000
 
 //#include <stdio.h>
 //static FILE *debug;
 
 
+/* priority classes of a bus queue, lower values get the bus first */
+typedef enum Bus_Priority {
+	BUS_WRITE = 0,          /* brightness set by the user */
+	BUS_READ,               /* brightness asked for by the user */
+	BUS_BACKGROUND,         /* verification and health probes, dropped when user requests queue up */
+	BUS_PRIORITY_COUNT
+} Bus_Priority;
+
+/* serializes ddc operations of all displays on one bus by priority */
+typedef struct Bus_Queue {
+	int busno;
+	bool busy;
+	int waiting[BUS_PRIORITY_COUNT];
+	bool probing;           /* a discovery probe runs on this bus, guarded by the lock of the Probe_Queue */
+	unsigned int user_requests; /* counts queued user requests, so waiting background operations notice them */
+	int fd;                 /* /dev/i2c-N for the flock against other processes, -1 if they are not kept off */
+	bool locked;            /* the flock is held, only touched by the holder of the bus */
+	long unlocked_at;       /* time in ms the flock was given back, only touched by the holder of the bus */
+	char dpms[96];          /* dpms file of the drm connector of the bus, empty if there is none */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} Bus_Queue;
+
+/* features read in one pass while a display is open during discovery, indices of Display_Info.snapshot */
+typedef enum Snapshot_Index {
+	SNAPSHOT_BRIGHTNESS = 0,
+	SNAPSHOT_CONTRAST,
+	SNAPSHOT_POWER_MODE,
+	SNAPSHOT_SIZE
+} Snapshot_Index;
+
+static const int snapshot_codes[SNAPSHOT_SIZE] = {
+	[SNAPSHOT_BRIGHTNESS] = BRIGHTNESS_VCP_CODE,
+	[SNAPSHOT_CONTRAST] = CONTRAST_VCP_CODE,
+	[SNAPSHOT_POWER_MODE] = POWER_MODE_VCP_CODE
+};
+
 /* information and references to a monitor */
 typedef struct Display_Info {
 	int dispno;
-	DDCA_Display_Ref *ref;
+	Bus_Queue *bus;
+	Display_Id id; /* DISPLAY_ID_NONE for a free slot or until discovery is done */
+	void *ref; /* reference of the backend */
 	char *name;
+	uint32_t identity; /* hash of the edid or the name, the generation of the id is made from it */
 	int wanted_brightness;
+	unsigned int wanted_trace_id; /* correlation id of wanted_brightness for tracepoints */
+	long op_started; /* start of the running ddc operation in ms, 0 if there is none */
+	bool degraded; /* monitor did not answer in time, only probes are sent */
+	bool asleep; /* monitor is in standby, wanted_brightness waits for it to wake up */
+	Ddc_Value snapshot[SNAPSHOT_SIZE]; /* values of discovery, current is -1 for unsupported features, brightness max scales percentages */
+	int cached_brightness; /* last brightness known from the monitor, guarded by health_lock */
+	long cached_at; /* time of cached_brightness in ms, 0 if there is none */
 } Display_Info;
 
 /* parameters for a brightness-change-thread */
 typedef struct Brightness_Thread {
-	int dispnum;
+	int slot;
 	pthread_t id;
 	pthread_mutex_t lock;
 	pthread_cond_t cond;
 	bool cont; /* thread will end itself, when this is set to false */
+	unsigned int requests; /* counts new wanted values, guarded by lock */
+	bool parked; /* thread waits for the system to resume without an open handle, guarded by lock */
 } Brightness_Thread;
 
+/* candidates of the discovery, shared by the probe threads */
+typedef struct Probe_Queue {
+	Display_Info *candidates;
+	bool *taken;
+	int count;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} Probe_Queue;
+
 /* parameters for a ask-for-brightness-thread */
 typedef struct Brightness_Store{
 	int dispnum;
@@ -55,185 +164,1129 @@ typedef struct Brightness_Store{
 	void (*callback)(int, void*);
 } Brightness_Store;
 
-/* array of all displays, supporting brightness change */
-static Display_Info **info = NULL;
+/* table of all displays supporting brightness change, indexed by the slot of their id */
+static Display_Info table[MAX_DDC_DISPLAYS];
+/* ids of all displays sorted by dispno, for enumerating them */
+static Display_Id order[MAX_DDC_DISPLAYS];
+
+/* thread of every used slot */
+static Brightness_Thread *brightness_change_threads[MAX_DDC_DISPLAYS];
 
-/* array with all threads */
-static Brightness_Thread **brightness_change_threads = NULL;
+/* one queue per bus, there are never more buses than displays */
+static Bus_Queue buses[MAX_DDC_DISPLAYS];
+static int buscount = 0;
 
-/* mutex for Display_Info-array prevents race condition and memory leak when building up the whole array  */
+/* mutex for the display table, serializes adding and removing displays */
 static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 /* adds thread safety for creating and destroying the whole stuff */
 static pthread_mutex_t freemutex = PTHREAD_MUTEX_INITIALIZER;
 
-static DDCA_Display_Info_List *zlist = NULL;
+/* backend set by the user of ddcwrapper and the one in use, which may be the trace replay */
+static const Ddc_Backend *user_backend = NULL;
+static const Ddc_Backend *backend = NULL;
+
+/* watchdog, that marks displays with hanging operations as degraded */
+static pthread_t watchdog;
+static bool watchdog_running = false;
+/* guards op_started and degraded of all displays */
+static pthread_mutex_t health_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t health_cond;
+/* health_cond is made once and kept for the next discoveries, guarded by freemutex */
+static bool health_cond_ready = false;
+/* candidates while discovery runs, they are not in the table yet, guarded by health_lock */
+static Display_Info *probed = NULL;
+static int probedcount = 0;
+
+static void (*state_callback)(Display_Id, int) = NULL;
+
+/* time of the last request from the applet in ms, threads park after IDLE_AFTER_MS without one */
+static long last_request = 0;
+/* counts every wakeup of the worker and watchdog threads, it stands still while idle */
+static unsigned long wakeups = 0;
+
+/* the system goes to sleep or sleeps, nothing is sent until it resumes */
+static bool suspended = false;
+
+/* transactions, that had to wait for another process on the bus, and the ones, that gave up waiting */
+static unsigned long bus_contentions = 0;
+static unsigned long bus_lock_timeouts = 0;
 
 /* number of displays supporting brightness change */
 static int displaycount = -1;
 
-/* compare-function for quicksort */
+/* compare-function for quicksort, sorts ids by dispno */
 static int cmp(const void* a, const void* b) 
 {
-	return ((*(Display_Info**) a) -> dispno) - ((*(Display_Info**) b) -> dispno);
+	return table[DISPLAY_ID_SLOT(*(Display_Id*) a)].dispno - table[DISPLAY_ID_SLOT(*(Display_Id*) b)].dispno;
 }
 
-static void error(DDCA_Status code) 
+static void error(int code) 
 {
-    fprintf(stderr, "%s: %s\n",
-        ddca_rc_name(code),
-        ddca_rc_desc(code)
+    fprintf(stderr, "%d: %s\n",
+        code,
+        backend -> describe(code)
     );
 }
 
-static void error2(DDCA_Status code, char *msg)
+static void error2(int code, char *msg)
 {
     error(code);
     fprintf(stderr, "%s\n", msg);
 }
 
 /**
- * adds a display to info array thread save and sorts it
+ * monotonic time in milliseconds
+ */
+static long now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * waits on cond at most ms milliseconds, cond has to use the monotonic clock
+ */
+static void timed_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, long ms)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+/**
+ * counts a wakeup of a thread
+ */
+static void count_wakeup()
+{
+	__atomic_add_fetch(&wakeups, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * remembers, that the applet asked for something
  */
-static void add_display(Display_Info *new) 
+static void note_request()
+{
+	__atomic_store_n(&last_request, now_ms(), __ATOMIC_RELAXED);
+}
+
+/**
+ * tells, if the system is about to sleep
+ */
+static bool is_suspended()
+{
+	return __atomic_load_n(&suspended, __ATOMIC_RELAXED);
+}
+
+/**
+ * tells, if nobody asked for anything for a while
+ */
+static bool is_idle()
+{
+	return now_ms() - __atomic_load_n(&last_request, __ATOMIC_RELAXED) > IDLE_AFTER_MS;
+}
+
+/**
+ * initializes a conditional, that can be used by timed_wait
+ */
+static int monotonic_cond_init(pthread_cond_t *cond)
+{
+	pthread_condattr_t attr;
+	int status;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	status = pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+	return status;
+}
+
+/**
+ * changes degraded state of a display and tells the callback
+ * has to be called with health_lock held
+ */
+static void set_degraded(Display_Info *dinfo, bool degraded)
+{
+	if (dinfo -> degraded == degraded)
+		return;
+
+	dinfo -> degraded = degraded;
+	fprintf(stderr, degraded ? "Display %d does not respond, degrading it\n" : "Display %d responds again\n", dinfo -> dispno);
+
+	/* displays are reported after discovery only */
+	if (state_callback != NULL && dinfo -> id != DISPLAY_ID_NONE)
+		state_callback(dinfo -> id, degraded);
+}
+
+/**
+ * marks the begin of a ddc operation, so the watchdog can see it
+ */
+static void op_begin(Display_Info *dinfo)
+{
+	pthread_mutex_lock(&health_lock);
+	if (dinfo -> op_started == 0) {
+		dinfo -> op_started = now_ms();
+		pthread_cond_signal(&health_cond);
+	}
+	pthread_mutex_unlock(&health_lock);
+}
+
+/**
+ * marks the end of a ddc operation, an answer of the monitor in time makes a display healthy again
+ * opening only talks to the kernel, so it never counts as answer
+ */
+static void op_end(Display_Info *dinfo, int rc, bool answered)
+{
+	pthread_mutex_lock(&health_lock);
+	if (now_ms() - dinfo -> op_started > OP_DEADLINE_MS)
+		set_degraded(dinfo, true);
+	else if (answered && rc == 0)
+		set_degraded(dinfo, false);
+	dinfo -> op_started = 0;
+	pthread_mutex_unlock(&health_lock);
+}
+
+/**
+ * returns, if the display is degraded
+ */
+static bool is_degraded(Display_Info *dinfo)
+{
+	pthread_mutex_lock(&health_lock);
+	bool degraded = dinfo -> degraded;
+	pthread_mutex_unlock(&health_lock);
+	return degraded;
+}
+
+/**
+ * changes the power state of a display, has to be called with health_lock held
+ */
+static void set_asleep(Display_Info *dinfo, bool asleep)
+{
+	if (dinfo -> asleep == asleep)
+		return;
+
+	dinfo -> asleep = asleep;
+	fprintf(stderr, asleep ? "Display %d is in standby, holding its brightness\n" : "Display %d woke up\n", dinfo -> dispno);
+}
+
+/**
+ * returns, if the display is in standby
+ */
+static bool is_asleep(Display_Info *dinfo)
+{
+	pthread_mutex_lock(&health_lock);
+	bool asleep = dinfo -> asleep;
+	pthread_mutex_unlock(&health_lock);
+	return asleep;
+}
+
+/**
+ * remembers a brightness, that the monitor reported or confirmed
+ */
+static void cache_brightness(Display_Info *dinfo, int brightness)
+{
+	pthread_mutex_lock(&health_lock);
+	dinfo -> cached_brightness = brightness;
+	dinfo -> cached_at = now_ms();
+	pthread_mutex_unlock(&health_lock);
+}
+
+/**
+ * forgets the cached brightness, because another one is on the way
+ */
+static void invalidate_brightness(Display_Info *dinfo)
+{
+	pthread_mutex_lock(&health_lock);
+	dinfo -> cached_at = 0;
+	pthread_mutex_unlock(&health_lock);
+}
+
+/**
+ * returns the cached brightness, -1 if there is none or it is too old
+ */
+static int cached_brightness(Display_Info *dinfo)
+{
+	pthread_mutex_lock(&health_lock);
+	int brightness = -1;
+	if (dinfo -> cached_at != 0 && now_ms() - dinfo -> cached_at < VALUE_CACHE_MS)
+		brightness = dinfo -> cached_brightness;
+	pthread_mutex_unlock(&health_lock);
+	return brightness;
+}
+
+/**
+ * converts a raw brightness of the monitor to percent
+ */
+static int to_percentage(Display_Info *dinfo, int raw)
+{
+	return ddc_to_percentage(raw, dinfo -> snapshot[SNAPSHOT_BRIGHTNESS].max);
+}
+
+/**
+ * converts percent to a raw brightness of the monitor
+ */
+static int to_raw(Display_Info *dinfo, int percentage)
+{
+	return ddc_to_raw(percentage, dinfo -> snapshot[SNAPSHOT_BRIGHTNESS].max);
+}
+
+/**
+ * marks displays as degraded as soon as an operation misses its deadline
+ * sleeps without timeout while no operation is running
+ */
+static void watchdog_thread(void *val)
+{
+	pthread_mutex_lock(&health_lock);
+	while (watchdog_running) {
+		long now = now_ms();
+		long next = 0;
+
+		for (int i = 0; i < MAX_DDC_DISPLAYS; i++) {
+			Display_Info *dinfo = &table[i];
+			if (dinfo -> id == DISPLAY_ID_NONE || dinfo -> op_started == 0 || dinfo -> degraded)
+				continue;
+
+			long deadline = dinfo -> op_started + OP_DEADLINE_MS;
+			if (now >= deadline)
+				set_degraded(dinfo, true);
+			else if (next == 0 || deadline < next)
+				next = deadline;
+		}
+
+		if (next == 0)
+			pthread_cond_wait(&health_cond, &health_lock);
+		else
+			timed_wait(&health_cond, &health_lock, next - now);
+		count_wakeup();
+	}
+	pthread_mutex_unlock(&health_lock);
+}
+
+/**
+ * lets ddc_get_stalled_ms see the operations of discovery
+ */
+static void set_probed(Display_Info *candidates, int count)
+{
+	pthread_mutex_lock(&health_lock);
+	probed = candidates;
+	probedcount = count;
+	pthread_mutex_unlock(&health_lock);
+}
+
+/**
+ * returns, for how many ms the oldest running ddc operation hangs, 0 if none runs
+ */
+long ddc_get_stalled_ms()
+{
+	long now = now_ms();
+	long stalled = 0;
+
+	pthread_mutex_lock(&health_lock);
+	for (int i = 0; i < MAX_DDC_DISPLAYS + probedcount; i++) {
+		Display_Info *dinfo = i < MAX_DDC_DISPLAYS ? &table[i] : &probed[i - MAX_DDC_DISPLAYS];
+		if (dinfo -> op_started != 0 && now - dinfo -> op_started > stalled)
+			stalled = now - dinfo -> op_started;
+	}
+	pthread_mutex_unlock(&health_lock);
+	return stalled;
+}
+
+/**
+ * finds the dpms file of the drm connector, whose ddc channel is the bus, stores "" if there is none
+ */
+static void find_dpms(int busno, char *path, size_t size)
+{
+	DIR *drm = opendir(DRM_PATH);
+	struct dirent *entry;
+	char bus[16];
+
+	path[0] = '\0';
+	if (drm == NULL)
+		return;
+	snprintf(bus, sizeof(bus), "i2c-%d", busno);
+
+	while (path[0] == '\0' && (entry = readdir(drm)) != NULL) {
+		if (strncmp(entry -> d_name, "card", 4) != 0 || strchr(entry -> d_name, '-') == NULL)
+			continue;
+
+		/* the ddc link for most connectors, a child i2c-N for the aux channel of DisplayPort */
+		char link[PATH_MAX];
+		char child[PATH_MAX];
+		snprintf(child, sizeof(child), DRM_PATH "/%s/ddc", entry -> d_name);
+		ssize_t len = readlink(child, link, sizeof(link) - 1);
+		link[len > 0 ? len : 0] = '\0';
+		const char *base = strrchr(link, '/');
+		bool found = strcmp(base != NULL ? base + 1 : link, bus) == 0;
+
+		snprintf(child, sizeof(child), DRM_PATH "/%s/%s", entry -> d_name, bus);
+		if (found || access(child, F_OK) == 0)
+			snprintf(path, size, DRM_PATH "/%s/dpms", entry -> d_name);
+	}
+	closedir(drm);
+}
+
+/**
+ * returns the queue of a bus, creates it if needed
+ * is only called during discovery, before any operation is queued
+ */
+static Bus_Queue *get_bus(int busno)
+{
+	for (int i = 0; i < buscount; i++)
+		if (buses[i].busno == busno)
+			return &buses[i];
+
+	Bus_Queue *bus = &buses[buscount++];
+	bus -> busno = busno;
+	bus -> busy = false;
+	bus -> probing = false;
+	bus -> user_requests = 0;
+	bus -> locked = false;
+	bus -> unlocked_at = 0;
+	bus -> fd = -1;
+	for (int i = 0; i < BUS_PRIORITY_COUNT; i++)
+		bus -> waiting[i] = 0;
+	
+	/* ddcutil and friends flock the device file of the bus for a transaction, so does ddcwrapper */
+	if (busno >= 0 && (backend -> arbitrates_buses == NULL || !backend -> arbitrates_buses())) {
+		char path[PATH_MAX];
+		if (backend -> bus_device != NULL)
+			backend -> bus_device(busno, path, sizeof(path));
+		else
+			snprintf(path, sizeof(path), "/dev/i2c-%d", busno);
+		bus -> fd = open(path, O_RDONLY | O_CLOEXEC);
+	}
+	
+	/* a replayed trace has nothing to do with the monitors of this machine */
+	if (busno >= 0 && backend != &trace_replay_backend)
+		find_dpms(busno, bus -> dpms, sizeof(bus -> dpms));
+	else
+		bus -> dpms[0] = '\0';
+	pthread_mutex_init(&bus -> lock, NULL);
+	pthread_cond_init(&bus -> cond, NULL);
+	return bus;
+}
+
+/**
+ * true, if a request of higher priority than prio waits for the bus
+ */
+static bool bus_has_higher(Bus_Queue *bus, Bus_Priority prio)
+{
+	for (int i = 0; i < prio; i++)
+		if (bus -> waiting[i] > 0)
+			return true;
+	return false;
+}
+
+/**
+ * takes the flock of the bus, so other processes stay off it for one transaction
+ * if they do not give it up in time, the transaction goes on anyway
+ */
+static void bus_lock(Bus_Queue *bus)
+{
+	if (bus -> fd < 0)
+		return;
+
+	long gap = bus -> unlocked_at + BUS_LOCK_GAP_MS - now_ms();
+	if (gap > 0) {
+		struct timespec wait = { 0, gap * 1000000 };
+		nanosleep(&wait, NULL);
+	}
+
+	if (flock(bus -> fd, LOCK_EX | LOCK_NB) != 0) {
+		if (errno != EWOULDBLOCK)
+			return;
+		__atomic_add_fetch(&bus_contentions, 1, __ATOMIC_RELAXED);
+
+		long deadline = now_ms() + BUS_LOCK_WAIT_MS;
+		struct timespec poll = { 0, BUS_LOCK_POLL_MS * 1000000 };
+		while (flock(bus -> fd, LOCK_EX | LOCK_NB) != 0) {
+			if (errno != EWOULDBLOCK && errno != EINTR)
+				return;
+			if (now_ms() >= deadline) {
+				__atomic_add_fetch(&bus_lock_timeouts, 1, __ATOMIC_RELAXED);
+				fprintf(stderr, "Bus %d is still locked by another process, going on without the lock\n", bus -> busno);
+				return;
+			}
+			nanosleep(&poll, NULL);
+		}
+	}
+	bus -> locked = true;
+}
+
+/**
+ * gives the flock of the bus back
+ */
+static void bus_unlock(Bus_Queue *bus)
+{
+	if (bus -> locked) {
+		flock(bus -> fd, LOCK_UN);
+		bus -> unlocked_at = now_ms();
+	}
+	bus -> locked = false;
+}
+
+/**
+ * waits until the bus is free and no request of higher priority is waiting
+ * background requests give up and return false, as soon as a user request queues up behind them
+ */
+static bool bus_acquire(Bus_Queue *bus, Bus_Priority prio)
+{
+	bool dropped = false;
+
+	pthread_mutex_lock(&bus -> lock);
+
+	unsigned int user_requests = bus -> user_requests;
+	if (prio != BUS_BACKGROUND) {
+		bus -> user_requests++;
+		/* waiting background requests have to see it */
+		pthread_cond_broadcast(&bus -> cond);
+	}
+
+	bus -> waiting[prio]++;
+	while (bus -> busy || bus_has_higher(bus, prio)) {
+		pthread_cond_wait(&bus -> cond, &bus -> lock);
+		if (prio == BUS_BACKGROUND && bus -> user_requests != user_requests) {
+			dropped = true;
+			break;
+		}
+	}
+	bus -> waiting[prio]--;
+
+	if (!dropped)
+		bus -> busy = true;
+
+	pthread_mutex_unlock(&bus -> lock);
+	
+	/* other processes are waited for without blocking the queue lock */
+	if (!dropped)
+		bus_lock(bus);
+	return !dropped;
+}
+
+/**
+ * hands the bus to the next request
+ */
+static void bus_release(Bus_Queue *bus)
+{
+	bus_unlock(bus);
+	
+	pthread_mutex_lock(&bus -> lock);
+	bus -> busy = false;
+	pthread_cond_broadcast(&bus -> cond);
+	pthread_mutex_unlock(&bus -> lock);
+}
+
+/**
+ * opens a display, all ddc operations go through these dev_ functions,
+ * which feed the watchdog and record traces
+ */
+static int dev_open(Display_Info *dinfo, void **handle)
+{
+	int rc;
+	uint64_t start = trace_now_us();
+
+	op_begin(dinfo);
+	rc = backend -> open(dinfo -> ref, handle);
+	op_end(dinfo, rc, false);
+
+	trace_record(TRACE_OP_OPEN, dinfo -> dispno, 0, 0, 0, rc, start, trace_now_us());
+	return rc;
+}
+
+/**
+ * closes a display
+ */
+static int dev_close(Display_Info *dinfo, void *handle)
+{
+	int rc;
+	uint64_t start = trace_now_us();
+
+	rc = backend -> close(handle);
+
+	trace_record(TRACE_OP_CLOSE, dinfo -> dispno, 0, 0, 0, rc, start, trace_now_us());
+	return rc;
+}
+
+/**
+ * reads a non table vcp value
+ */
+static int dev_get(Display_Info *dinfo, void *handle, int code, Ddc_Value *val)
+{
+	int rc;
+	uint64_t start = trace_now_us();
+
+	op_begin(dinfo);
+	rc = backend -> get(handle, code, val);
+	op_end(dinfo, rc, true);
+
+	trace_record(TRACE_OP_GET, dinfo -> dispno, code,
+	             rc == 0 ? val -> current : 0,
+	             rc == 0 ? val -> max : 0,
+	             rc, start, trace_now_us());
+	return rc;
+}
+
+/**
+ * writes a non table vcp value
+ */
+static int dev_set(Display_Info *dinfo, void *handle, int code, int value)
+{
+	int rc;
+	uint64_t start = trace_now_us();
+
+	op_begin(dinfo);
+	rc = backend -> set(handle, code, value);
+	op_end(dinfo, rc, true);
+
+	trace_record(TRACE_OP_SET, dinfo -> dispno, code, value, 0, rc, start, trace_now_us());
+	return rc;
+}
+
+/**
+ * returns the display of id or NULL, if the id is stale
+ */
+static Display_Info *lookup(Display_Id id)
+{
+	unsigned int slot = DISPLAY_ID_SLOT(id);
+	if (id == DISPLAY_ID_NONE || slot >= MAX_DDC_DISPLAYS)
+		return NULL;
+	if (__atomic_load_n(&table[slot].id, __ATOMIC_ACQUIRE) != id)
+		return NULL;
+	return &table[slot];
+}
+
+/**
+ * copies a display into a free slot of the table thread save
+ * it can not be looked up before publish_display gives it its id
+ */
+static void add_display(Display_Info *new, int slot)
 {
 	/* ensure, that only one thread enters this area */
 	pthread_mutex_lock(&lock);
 	
-	int index = displaycount;
+	table[slot] = *new;
+	table[slot].id = DISPLAY_ID_NONE;
+	table[slot].op_started = 0;
+	table[slot].degraded = false;
+	table[slot].asleep = new -> snapshot[SNAPSHOT_POWER_MODE].current > POWER_MODE_ON;
 	displaycount++;
 	
-	/* resize array by one */
-	info = (Display_Info**) realloc(info, sizeof(Display_Info*) * sizeof(displaycount));
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * gives an added display its id, from now on it can be looked up
+ * the generation comes from the monitor, so a restarted helper gives the same
+ * monitor in the same slot the same id again, and another monitor another one
+ */
+static void publish_display(int slot)
+{
+	uint32_t generation = display_id_generation(table[slot].identity);
+	__atomic_store_n(&table[slot].id, DISPLAY_ID_MAKE(slot, generation), __ATOMIC_RELEASE);
+}
+
+/**
+ * frees the slot of a display, its id and all copies of it are stale, until the monitor is found again
+ * the thread of the slot has to be ended before
+ */
+static void remove_display(int slot)
+{
+	pthread_mutex_lock(&lock);
+	pthread_mutex_lock(&health_lock);
 	
-	info[index] = new;
+	Display_Id id = table[slot].id;
+	__atomic_store_n(&table[slot].id, DISPLAY_ID_NONE, __ATOMIC_RELEASE);
 	
-	/* sort displays by displaycount */
-	qsort(info, displaycount, sizeof(Display_Info*), cmp);
+	for (int i = 0; i < displaycount; i++) {
+		if (order[i] == id) {
+			memmove(&order[i], &order[i + 1], (displaycount - i - 1) * sizeof(Display_Id));
+			break;
+		}
+	}
+	displaycount--;
 	
+	pthread_mutex_unlock(&health_lock);
 	pthread_mutex_unlock(&lock);
 }
 
 /**
- * takes a look at every display and adds it to info array if it is able to change brightness
+ * takes a look at a display and stores its brightness, if it is able to change it
+ * wanted_brightness stays -1 otherwise, returns the status of the probe
+ * the other features of the snapshot are read while the display is open anyway
  */
-static void init_threaded(void *voidref) 
+static int probe_candidate(Display_Info *parms) 
 {
-	DDCA_Status rc = 0;
-	
-	/* convert parameters for thread */
-	Display_Info *parms = voidref;
+	int rc = 0;
 
 	/* open display */
-	DDCA_Display_Handle handle;
-	rc = ddca_open_display2(*parms -> ref, true, &handle);
+	void *handle;
+	rc = dev_open(parms, &handle);
 	if (rc != 0) {
-	    free(parms);
 	    error(rc);
-	    return;
+	    return rc;
 	}
 	
 	/* read current brightness value */
-	DDCA_Non_Table_Vcp_Value val;
-	rc = ddca_get_non_table_vcp_value(handle, BRIGHTNESS_VCP_CODE, &val);
-	if (rc == 0) {
-	    /* permanently add display to infolist */
-	    add_display(parms);
-	    parms -> wanted_brightness = val.sl;
+	Ddc_Value val;
+	int status = dev_get(parms, handle, BRIGHTNESS_VCP_CODE, &val);
+	if (status == 0) {
+	    /* display supports brightness change, everything above works in percent of its maximum */
+	    parms -> snapshot[SNAPSHOT_BRIGHTNESS] = val;
+	    parms -> wanted_brightness = to_percentage(parms, val.current);
+	    parms -> cached_brightness = parms -> wanted_brightness;
+	    parms -> cached_at = now_ms();
+	    
+	    /* a monitor without one of the other features just says so, that costs no retries */
+	    for (int i = SNAPSHOT_BRIGHTNESS + 1; i < SNAPSHOT_SIZE; i++)
+	        if (dev_get(parms, handle, snapshot_codes[i], &parms -> snapshot[i]) != 0)
+	            parms -> snapshot[i].current = -1;
 	} else {
 	    /* forget thata display, if requesting brightness fails */
-	    free(parms);
-	    error(rc);
+	    error(status);
 	}
 	
 	/* close display */
-	rc = ddca_close_display(handle);
+	rc = dev_close(parms, handle);
 	if (rc != 0) {
 	    error(rc);
 	}
-	   
+	return status;
+}
+
+/**
+ * takes the next candidate, whose bus is free, NULL when all are taken
+ * has to be called with the lock of the queue held, waits for a bus to get free
+ */
+static Display_Info *next_candidate(Probe_Queue *queue)
+{
+	for (;;) {
+		bool left = false;
+		for (int i = 0; i < queue -> count; i++) {
+			Display_Info *candidate = &queue -> candidates[i];
+			if (queue -> taken[i])
+				continue;
+			left = true;
+			if (!candidate -> bus -> probing) {
+				queue -> taken[i] = true;
+				candidate -> bus -> probing = true;
+				return candidate;
+			}
+		}
+		if (!left)
+			return NULL;
+		pthread_cond_wait(&queue -> cond, &queue -> lock);
+	}
+}
+
+/**
+ * probes candidates until none is left, monitors on one bus are probed one after another,
+ * so they do not collide, transient failures are tried again, definite answers are not
+ */
+static void probe_thread(void *val)
+{
+	Probe_Queue *queue = val;
+	Display_Info *candidate;
+
+	pthread_mutex_lock(&queue -> lock);
+	while ((candidate = next_candidate(queue)) != NULL) {
+		pthread_mutex_unlock(&queue -> lock);
+
+		for (int attempt = 1; attempt <= PROBE_ATTEMPTS; attempt++) {
+			/* the probe is the only user of the bus in this process, other processes are kept off */
+			bus_lock(candidate -> bus);
+			int rc = probe_candidate(candidate);
+			bus_unlock(candidate -> bus);
+			if (rc == 0 || !backend -> is_transient(rc))
+				break;
+		}
+
+		pthread_mutex_lock(&queue -> lock);
+		candidate -> bus -> probing = false;
+		pthread_cond_broadcast(&queue -> cond);
+	}
+	pthread_mutex_unlock(&queue -> lock);
 }
 
 /**
  * verifies set brightness via vcp
  */
-static bool verify_brightness(DDCA_Display_Handle *handle, int wanted_brightness)
+static bool verify_brightness(Display_Info *dinfo, void **handle, int wanted_brightness)
 {
   /* handle needs to be initialized */
   if (*handle == NULL)
     return true;
 
-  DDCA_Status rc = 0;
-  DDCA_Non_Table_Vcp_Value val;
+  int rc = 0;
+  Ddc_Value val;
   /* ask current brightness value */
-  rc = ddca_get_non_table_vcp_value(*handle, BRIGHTNESS_VCP_CODE, &val);
+  rc = dev_get(dinfo, *handle, BRIGHTNESS_VCP_CODE, &val);
   if (rc != 0) {
     error2(rc, "Error verifying brightness value");
     return false;
   }
 
-  return val.sl == wanted_brightness;
+  return val.current == to_raw(dinfo, wanted_brightness);
+}
+
+/**
+ * closes handle, if it is open
+ */
+static void close_handle(Display_Info *dinfo, void **handle, char *msg)
+{
+	if (*handle != NULL) {
+		int rc = dev_close(dinfo, *handle);
+		if (rc != 0)
+			error2(rc, msg);
+		*handle = NULL;
+	}
+}
+
+/**
+ * reads brightness once to find out, if a degraded display responds again
+ */
+static bool probe_display(Display_Info *dinfo, void **handle)
+{
+	int rc;
+	Ddc_Value val;
+
+	rc = dev_open(dinfo, handle);
+	if (rc == 0)
+		rc = dev_get(dinfo, *handle, BRIGHTNESS_VCP_CODE, &val);
+
+	if (rc != 0 || is_degraded(dinfo)) {
+		close_handle(dinfo, handle, "Error closing handle after probe");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * asks the kernel for the dpms state of the connector, 1 if it is on, 0 if not, -1 if it is unknown
+ */
+static int dpms_on(Display_Info *dinfo)
+{
+	char state[16];
+	FILE *file;
+
+	if (dinfo -> bus -> dpms[0] == '\0' || (file = fopen(dinfo -> bus -> dpms, "r")) == NULL)
+		return -1;
+	bool known = fgets(state, sizeof(state), file) != NULL;
+	fclose(file);
+	if (!known)
+		return -1;
+	return strncmp(state, "On", 2) == 0;
+}
+
+/**
+ * asks the monitor for its power mode, this costs a transaction, so it is the last resort
+ * returns the mode or -1, if the monitor did not answer or a user request came first
+ */
+static int read_power_mode(Display_Info *dinfo)
+{
+	void *handle;
+	Ddc_Value val;
+	int rc;
+
+	if (!bus_acquire(dinfo -> bus, BUS_BACKGROUND))
+		return -1;
+	rc = dev_open(dinfo, &handle);
+	if (rc == 0) {
+		rc = dev_get(dinfo, handle, POWER_MODE_VCP_CODE, &val);
+		dev_close(dinfo, handle);
+	}
+	bus_release(dinfo -> bus);
+	return rc == 0 ? val.current : -1;
+}
+
+/**
+ * tells, if a sleeping monitor woke up, the monitor is only asked, if the kernel does not know
+ */
+static bool has_woken(Display_Info *dinfo)
+{
+	int on = dpms_on(dinfo);
+	if (on >= 0)
+		return on;
+	return read_power_mode(dinfo) == POWER_MODE_ON;
+}
+
+/**
+ * returns the time to wait after failures consecutive failures, doubled each time and jittered
+ */
+static long backoff_delay(int failures, unsigned int *seed)
+{
+	long delay = BACKOFF_MAX_MS;
+	if (failures <= 16)
+		delay = BACKOFF_BASE_MS << (failures > 0 ? failures - 1 : 0);
+	if (delay > BACKOFF_MAX_MS)
+		delay = BACKOFF_MAX_MS;
+
+	/* wait at least half of the delay, so monitors on one bus do not retry in lockstep */
+	return delay / 2 + rand_r(seed) % (delay / 2 + 1);
+}
+
+/**
+ * sleeps until deadline or until the thread has to end, new brightness values do not wake it
+ */
+static void wait_until(Brightness_Thread *myinfo, long deadline)
+{
+	pthread_mutex_lock(&myinfo -> lock);
+	while (myinfo -> cont && !is_suspended() && now_ms() < deadline) {
+		timed_wait(&myinfo -> cond, &myinfo -> lock, deadline - now_ms());
+		count_wakeup();
+	}
+	pthread_mutex_unlock(&myinfo -> lock);
+}
+
+/**
+ * sleeps without any timeout until a new brightness is wanted or the thread has to end
+ * seen is the request count, the thread knows about
+ */
+static void wait_for_request(Brightness_Thread *myinfo, unsigned int *seen)
+{
+	pthread_mutex_lock(&myinfo -> lock);
+	while (myinfo -> cont && myinfo -> requests == *seen) {
+		pthread_cond_wait(&myinfo -> cond, &myinfo -> lock);
+		count_wakeup();
+	}
+	*seen = myinfo -> requests;
+	pthread_mutex_unlock(&myinfo -> lock);
+}
+
+/**
+ * waits until the system resumes, the handle of the worker has to be closed before
+ * ddc_prepare_for_sleep waits for parked to become true
+ */
+static void park_for_sleep(Brightness_Thread *myinfo)
+{
+	pthread_mutex_lock(&myinfo -> lock);
+	myinfo -> parked = true;
+	pthread_cond_broadcast(&myinfo -> cond);
+	while (myinfo -> cont && is_suspended()) {
+		pthread_cond_wait(&myinfo -> cond, &myinfo -> lock);
+		count_wakeup();
+	}
+	myinfo -> parked = false;
+	pthread_mutex_unlock(&myinfo -> lock);
+}
+
+/**
+ * tells the thread of a display, that there is a new wanted brightness
+ */
+static void wake_worker(int slot)
+{
+	Brightness_Thread *thread = brightness_change_threads[slot];
+	pthread_mutex_lock(&thread -> lock);
+	thread -> requests++;
+	pthread_cond_signal(&thread -> cond);
+	pthread_mutex_unlock(&thread -> lock);
+}
+
+/**
+ * counts a failed operation, too many of them open the circuit breaker by degrading the display
+ */
+static void record_failure(Display_Info *dinfo, int *failures, bool *backoff)
+{
+	(*failures)++;
+	*backoff = true;
+
+	if (*failures >= BREAKER_THRESHOLD) {
+		pthread_mutex_lock(&health_lock);
+		set_degraded(dinfo, true);
+		pthread_mutex_unlock(&health_lock);
+	}
 }
 
 /**
  * thread to set Brightness for one Monitor
+ * failed operations are retried with backoff, the latest wanted brightness is never dropped
  */
 static void set_brightness_thread(void* val)
 {
     
-  DDCA_Status rc = 0;
+  int rc = 0;
 
 	Brightness_Thread *myinfo = val;
-	Display_Info *dinfo = info[myinfo -> dispnum];
+	Display_Info *dinfo = &table[myinfo -> slot];
 
-	int last_brightness = dinfo -> wanted_brightness;
-	pthread_mutex_t *lock = &myinfo -> lock;
-	pthread_cond_t *cond = &myinfo -> cond;
+	/* the value found by discovery, a brightness wanted before the thread ran still gets written */
+	int last_brightness = to_percentage(dinfo, dinfo -> snapshot[SNAPSHOT_BRIGHTNESS].current);
+	unsigned int seen = 0;
 	bool *cont = &myinfo -> cont;
 	
-	DDCA_Display_Handle handle = NULL;
+	void *handle = NULL;
+	
+	int failures = 0; /* consecutive failures, reset when brightness is verified */
+	bool backoff = false; /* last operation failed, wait before trying again */
+	unsigned int seed = dinfo -> dispno ^ (unsigned int) now_ms();
 	
 	/* set brightness in a loop */
-	while(*cont && rc == 0) {
+	while(*cont) {
 	
+		/* system goes to sleep, buses may be different after it resumes */
+		if (is_suspended()) {
+			close_handle(dinfo, &handle, "Error closing handle 6");
+			park_for_sleep(myinfo);
+			if (!*cont)
+				break;
+			
+			/* the latest wanted brightness is written and verified again, which checks the display as well */
+			last_brightness = -1;
+			failures = 0;
+			backoff = false;
+			continue;
+		}
+		
+		/* monitor is in standby, nothing is sent but the latest wanted brightness waits for it */
+		if (is_asleep(dinfo)) {
+			close_handle(dinfo, &handle, "Error closing handle 5");
+			
+			if (is_idle() || dinfo -> wanted_brightness == last_brightness)
+				wait_for_request(myinfo, &seen);
+			else
+				wait_until(myinfo, now_ms() + POWER_CHECK_INTERVAL_MS);
+			if (!*cont)
+				break;
+			if (is_suspended())
+				continue;
+			if (!has_woken(dinfo))
+				continue;
+			
+			pthread_mutex_lock(&health_lock);
+			set_asleep(dinfo, false);
+			pthread_mutex_unlock(&health_lock);
+			failures = 0;
+			backoff = false;
+			continue;
+		}
+		
+		/* circuit breaker is open, do not send anything until a probe succeeds */
+		if (is_degraded(dinfo)) {
+			close_handle(dinfo, &handle, "Error closing handle 2");
+			
+			if (is_idle()) {
+				/* nobody cares right now, the next request gets probed at once */
+				wait_for_request(myinfo, &seen);
+			} else {
+				long delay = backoff_delay(failures, &seed);
+				wait_until(myinfo, now_ms() + (delay > HEALTH_PROBE_INTERVAL_MS ? delay : HEALTH_PROBE_INTERVAL_MS));
+			}
+			if (!*cont)
+				break;
+			if (is_suspended())
+				continue;
+			
+			/* a probe gives way to the user, it is tried again next interval */
+			if (!bus_acquire(dinfo -> bus, BUS_BACKGROUND))
+				continue;
+			bool alive = probe_display(dinfo, &handle);
+			bus_release(dinfo -> bus);
+			if (!alive) {
+				failures++;
+				continue;
+			}
+			
+			/* monitor answers again, write the latest wanted brightness */
+			failures = 0;
+			backoff = false;
+			last_brightness = -1;
+			
+		/* wait a bit before trying again */
+		} else if (backoff) {
+			close_handle(dinfo, &handle, "Error closing handle 3");
+			wait_until(myinfo, now_ms() + backoff_delay(failures, &seed));
+			backoff = false;
+			continue;
+		
 		/* fall asleep when whished brightness is already set */
-		if (dinfo -> wanted_brightness == last_brightness && verify_brightness(&handle, dinfo -> wanted_brightness)) {
-
-		  /* close display before sleeping */
-		  if (handle != NULL) {
-			  rc = ddca_close_display(handle);
-			  if (rc != 0) {
-			      error2(rc, "Error closing handle 0");
-			  }
-		  }
-
-		  /* sleep until another thread wakes you up */
-		  pthread_mutex_lock(lock);
-		  pthread_cond_wait(cond, lock);
-		  pthread_mutex_unlock(lock);
-
-      /* exit thread */
-		  if (!*cont)
-			  break;
-
-		  /* open display again, when need to change brightness */
-		  rc = ddca_open_display2(*dinfo -> ref, true, &handle);
-		  if (rc != 0) {
-		      error2(rc, "Error opening display");
-		  }
+		} else if (dinfo -> wanted_brightness == last_brightness) {
+		
+			/* verification gives way to the user, it is tried again afterwards */
+			bool queued = handle != NULL;
+			if (queued && !bus_acquire(dinfo -> bus, BUS_BACKGROUND))
+				continue;
+			bool verified = verify_brightness(dinfo, &handle, last_brightness);
+			if (queued)
+				bus_release(dinfo -> bus);
+			PROBE(verify_done, dinfo -> wanted_trace_id, dinfo -> id, verified);
+			if (verified) {
+				failures = 0;
+				if (queued)
+					cache_brightness(dinfo, last_brightness);
+				
+				/* close display before sleeping */
+				close_handle(dinfo, &handle, "Error closing handle 0");
+				
+				/* sleep until another thread wakes you up, requests coming in meanwhile are not lost */
+				wait_for_request(myinfo, &seen);
+				PROBE(worker_wakeup, dinfo -> wanted_trace_id, dinfo -> id, dinfo -> wanted_brightness);
+				continue;
+			}
 			
+			/* monitor shows another value or did not answer, write it again */
+			last_brightness = -1;
+			record_failure(dinfo, &failures, &backoff);
+			continue;
+		}
+		
+		/* a write to a monitor in standby would only time out, it waits for the monitor instead */
+		if (dpms_on(dinfo) == 0) {
+			pthread_mutex_lock(&health_lock);
+			set_asleep(dinfo, true);
+			pthread_mutex_unlock(&health_lock);
+			continue;
+		}
+		
+		/* user writes get the bus first, values coming in meanwhile replace the target */
+		bus_acquire(dinfo -> bus, BUS_WRITE);
+		
+		/* open display again, when need to change brightness */
+		if (handle == NULL) {
+			rc = dev_open(dinfo, &handle);
+			PROBE(open_done, dinfo -> wanted_trace_id, dinfo -> id, rc);
+			if (rc != 0) {
+				bus_release(dinfo -> bus);
+				error2(rc, "Error opening display");
+				handle = NULL;
+				record_failure(dinfo, &failures, &backoff);
+				continue;
+			}
 		}
 		
 		/* set brightness value */
-		last_brightness = dinfo -> wanted_brightness;
-		rc = ddca_set_non_table_vcp_value(handle, BRIGHTNESS_VCP_CODE, 0, last_brightness);
+		int target = dinfo -> wanted_brightness;
+		unsigned int trace_id = dinfo -> wanted_trace_id;
+		PROBE(write_start, trace_id, dinfo -> id, target);
+		rc = dev_set(dinfo, handle, BRIGHTNESS_VCP_CODE, to_raw(dinfo, target));
+		bus_release(dinfo -> bus);
+		PROBE(write_done, trace_id, dinfo -> id, rc);
 		if (rc != 0) {
-		    error2(rc, "Error setting brightness");
-		    rc = ddca_close_display(handle);
-		    if (rc != 0)
-		        error2(rc, "Error closing handle 1");
+			error2(rc, "Error setting brightness");
+			close_handle(dinfo, &handle, "Error closing handle 1");
+			
+			/* without dpms in sysfs the monitor is asked once, if it failed because it sleeps */
+			int mode = dpms_on(dinfo) < 0 ? read_power_mode(dinfo) : -1;
+			if (mode > POWER_MODE_ON) {
+				pthread_mutex_lock(&health_lock);
+				set_asleep(dinfo, true);
+				pthread_mutex_unlock(&health_lock);
+				continue;
+			}
+			
+			/* last_brightness stays, so the target gets written again */
+			record_failure(dinfo, &failures, &backoff);
+			continue;
 		}
+		last_brightness = target;
 		
 	}
+	
+	close_handle(dinfo, &handle, "Error closing handle 4");
 }
 
 /**
@@ -247,6 +1300,16 @@ static int error_initialization(char *message, int status)
     return 0;
 }
 
+/**
+ * sets the backend, that talks to the monitors, before initializing
+ */
+void ddc_set_backend(const Ddc_Backend *new_backend)
+{
+	pthread_mutex_lock(&freemutex);
+	user_backend = new_backend;
+	pthread_mutex_unlock(&freemutex);
+}
+
 /**
  * initializes ddcci stuff and gives back the number of compatible displays
  */
@@ -265,80 +1328,133 @@ int ddc_count_displays_and_init()
 		/* initialize */
 		int status;
 		displaycount = 0;
-
-		/* free old stuff, if any */
-		//ddc_free();
-		if (info != NULL) {
-		    return error_initialization("info is NULL", 0);
-		}
 		
+		/* probes tell the watchdog about their operations already */
+		if (!health_cond_ready) {
+			if (monotonic_cond_init(&health_cond) != 0) {
+				return error_initialization("Error creating synchronisation puffers: \n", 0);
+			}
+			health_cond_ready = true;
+		}
 		
-		//debug = fopen("/tmp/applet_debug.txt", "a+");
-		//ddca_get_display_info_list2(true, &zlist);
-		//fprintf(debug, "count(false): %d\n", zlist -> ct);
-		//for (int i = 0; i < zlist -> ct; i++) {
-		//    DDCA_Display_Info *info = &zlist -> info[i];
-		//    
-		//    fprintf(debug, "name %d: %s\n", i, info -> model_name);
-		//}
-		//ddca_free_display_info_list(zlist);
-		//fprintf(debug, "\n");
+		/* opt-in tracing for offline analysis of monitor timing, a replay replaces the backend */
+		const char *tracepath;
+		backend = user_backend;
+		if ((tracepath = getenv(TRACE_REPLAY_ENV)) != NULL) {
+			if (trace_replay_open(tracepath) == 0)
+				backend = &trace_replay_backend;
+		} else if ((tracepath = getenv(TRACE_RECORD_ENV)) != NULL) {
+			trace_record_open(tracepath);
+		}
 		
-		/* higher up ddc retries to ensure every monitor will be found */
-		if ((status = ddca_set_max_tries(DDCA_MULTI_PART_TRIES, 15)) < 0) {
-			return error_initialization("Error setting retries: %d\n", status);
+		if (backend == NULL) {
+			return error_initialization("No ddc backend set\n", 0);
 		}
-
-		/* count number of supported displays */
-		if ((status = ddca_get_display_info_list2(true, &zlist)) < 0) {
+		
+		/* every display gets the slot of its position in the list, so ids stay the same for the same setup */
+		Ddc_Backend_Display found[MAX_DDC_DISPLAYS];
+		int count = 0;
+		if ((status = backend -> discover(found, MAX_DDC_DISPLAYS, &count)) != 0) {
 			return error_initialization("Error asking for displaylist: %d\n", status);
 		}
-				
 		
-		int count = zlist -> ct;
+		/* nothing to probe, zero sized arrays are undefined */
+		if (count <= 0) {
+			pthread_mutex_unlock(&freemutex);
+			return displaycount;
+		}
+		Display_Info candidates[count];
 		
 		//fprintf(debug, "count: %d\n", count);
 		
-		/* Start threads. This makes the whole thing faster when using multiple monitors */
-		pthread_t threads[count];	
 		for (int i = 0; i < count; i++) {
 			
-			/* Store model name */
-			DDCA_Display_Info *info = &(zlist -> info[i]);
-		
 			/* Parameters for Thread */
-			Display_Info *dinfo = malloc(sizeof(Display_Info));
-			dinfo -> dispno = info -> dispno;
-			dinfo -> name = info -> model_name;
-			dinfo -> ref = &(info -> dref);
-			
-			/* init monitors in separate threads to speed the whole thing up */
-			if ((status = pthread_create(&threads[i], NULL, (void*)init_threaded, dinfo)) != 0) {
-				return error_initialization("Error creating thread: %d\n", status);
-			}
+			Display_Info *dinfo = &candidates[i];
+			dinfo -> id = DISPLAY_ID_NONE;
+			dinfo -> wanted_brightness = -1;
+			dinfo -> wanted_trace_id = 0;
+			dinfo -> op_started = 0;
+			dinfo -> degraded = false;
+			dinfo -> cached_at = 0;
+			for (int j = 0; j < SNAPSHOT_SIZE; j++)
+				dinfo -> snapshot[j] = (Ddc_Value) { -1, -1 };
 			
+			/* Store model name */
+			dinfo -> dispno = found[i].dispno;
+			/* displays, that are not on an i2c bus, do not share one */
+			dinfo -> bus = get_bus(found[i].busno >= 0 ? found[i].busno : -1 - found[i].dispno);
+			dinfo -> name = found[i].name;
+			dinfo -> ref = found[i].ref;
+			dinfo -> identity = found[i].identity != 0 ? found[i].identity :
+			                    ddc_hash(found[i].name, strlen(found[i].name), DDC_HASH_INIT);
+			trace_record_display(found[i].dispno, found[i].name);
+		}
+		
+		/* Start threads. Different buses are probed in parallel, this makes the whole thing faster when using multiple monitors */
+		bool taken[count];
+		memset(taken, 0, sizeof(taken));
+		Probe_Queue queue = { .candidates = candidates, .taken = taken, .count = count };
+		pthread_mutex_init(&queue.lock, NULL);
+		pthread_cond_init(&queue.cond, NULL);
+		set_probed(candidates, count);
+		
+		int threadcount = count < MAX_PARALLEL_PROBES ? count : MAX_PARALLEL_PROBES;
+		pthread_t threads[threadcount];
+		int started = 0;
+		for (; started < threadcount; started++)
+			if ((status = pthread_create(&threads[started], NULL, (void*)probe_thread, &queue)) != 0)
+				break;
+		
+		/* wait for all threads, the ones, that started, probe everything */
+		for (int i = 0; i < started; i++)
+			pthread_join(threads[i], NULL);
+		set_probed(NULL, 0);
+		pthread_mutex_destroy(&queue.lock);
+		pthread_cond_destroy(&queue.cond);
+		
+		if (started == 0) {
+			return error_initialization("Error creating thread: %d\n", status);
 		}
 		
-		/* wait for all threads */
+		/* add supported displays to the table and sort them once for enumeration */
 		for (int i = 0; i < count; i++) {
-			if ((status = pthread_join(threads[i], NULL)) != 0) {		
-				return error_initialization("Error joining threads: %d\n", status);
-			}
+			if (candidates[i].wanted_brightness < 0)
+				continue;
+			add_display(&candidates[i], i);
+			publish_display(i);
+			order[displaycount - 1] = table[i].id;
+		}
+		qsort(order, displaycount, sizeof(Display_Id), cmp);
+		
+		/* discovery counts as request, so degraded displays get probed for a while */
+		note_request();
+		
+		/* start watchdog before any operation can hang */
+		watchdog_running = true;
+		if ((status = pthread_create(&watchdog, NULL, (void*)watchdog_thread, NULL)) != 0) {
+			watchdog_running = false;
+			return error_initialization("Error creating thread: %d\n", status);
 		}
 		
 		/* create threads, that will change brightness later */
-		brightness_change_threads = calloc(displaycount, sizeof(Brightness_Thread*));
 		for (int i = 0; i < displaycount; i++) {
-			brightness_change_threads[i] = malloc(sizeof(Brightness_Thread));
-			brightness_change_threads[i] -> dispnum = i;
-			if ((pthread_mutex_init(&(brightness_change_threads[i] -> lock), NULL) || 
-				pthread_cond_init(&(brightness_change_threads[i] -> cond), NULL)) != 0) {		
+			int slot = DISPLAY_ID_SLOT(order[i]);
+			Brightness_Thread *thread = malloc(sizeof(Brightness_Thread));
+			thread -> slot = slot;
+			if ((pthread_mutex_init(&(thread -> lock), NULL) || 
+				monotonic_cond_init(&(thread -> cond))) != 0) {		
+				free(thread);
 				return error_initialization("Error creating synchronisation puffers: \n", 0);
 			}
-			brightness_change_threads[i] -> cont = true;
-			if ((status = pthread_create(&(brightness_change_threads[i] -> id), NULL, (void*)set_brightness_thread, brightness_change_threads[i])) != 0) {
+			thread -> cont = true;
+			thread -> requests = 0;
+			thread -> parked = false;
+			if ((status = pthread_create(&(thread -> id), NULL, (void*)set_brightness_thread, thread)) != 0) {
+				free(thread);
 				return error_initialization("Error creating thread: %d\n", status);	
 			}
+			brightness_change_threads[slot] = thread;
 		}
 
     	pthread_mutex_unlock(&freemutex);
@@ -349,43 +1465,89 @@ int ddc_count_displays_and_init()
 
 
 /**
- * returns the monitorname of selected display
+ * returns the id of the n-th display, displays are sorted by dispno
+ */
+Display_Id ddc_get_display_id(int n)
+{
+	if (n < 0 || n >= displaycount)
+		return DISPLAY_ID_NONE;
+	return order[n];
+}
+
+/**
+ * returns the monitorname of selected display or NULL, if the id is stale
+ */
+char *ddc_get_display_name(Display_Id id)
+{
+	Display_Info *dinfo = lookup(id);
+	return dinfo != NULL ? dinfo -> name : NULL;
+}
+
+/**
+ * returns the i2c bus of selected display, negative if it is not on an i2c bus or the id is stale
  */
-char *ddc_get_display_name(int dispnum)
+int ddc_get_bus_number(Display_Id id)
 {
-	return info[dispnum] -> name;
+	Display_Info *dinfo = lookup(id);
+	return dinfo != NULL ? dinfo -> bus -> busno : -1;
 }
 
 /**
- * returns brightness of selected display
+ * reads brightness of selected display at priority prio, returns -1 on failure
  */
-int ddc_get_brightness_percentage(int dispnum)
+static int read_brightness(Display_Id id, Bus_Priority prio)
 {
 
-    DDCA_Status rc;
+    int rc;
+    Display_Info *dinfo = lookup(id);
+
+	if (dinfo == NULL)
+		return -1;
+	note_request();
+
+	/* do not wait for a monitor, that does not answer or sleeps, the last wanted value is good enough */
+	if (is_degraded(dinfo) || is_asleep(dinfo) || is_suspended()) {
+		/* a parked thread probes the monitor again right away */
+		wake_worker(DISPLAY_ID_SLOT(id));
+		return dinfo -> wanted_brightness;
+	}
+
+	/* a value from the monitor, that is not too old, saves a transaction */
+	int cached = cached_brightness(dinfo);
+	if (cached >= 0)
+		return cached;
+
+	/* background reads give way to everything the user asked for */
+	if (!bus_acquire(dinfo -> bus, prio))
+		return -1;
 
 	/* Open Display */
-	DDCA_Display_Handle handle;
-	rc = ddca_open_display2(*info[dispnum] -> ref, true, &handle);
+	void *handle;
+	rc = dev_open(dinfo, &handle);
 	if (rc!= 0) {
+	    bus_release(dinfo -> bus);
 	    error(rc);
 	} else {
 	
 	    /* read out Value */
-	    DDCA_Non_Table_Vcp_Value val;
-	    rc = ddca_get_non_table_vcp_value(handle, BRIGHTNESS_VCP_CODE, &val);
+	    Ddc_Value val;
+	    rc = dev_get(dinfo, handle, BRIGHTNESS_VCP_CODE, &val);
 	    if (rc != 0) {
 	        error(rc);
-	        val.sl = 0;
+	        val.current = 0;
+	    } else {
+	        val.current = to_percentage(dinfo, val.current);
+	        cache_brightness(dinfo, val.current);
 	    }
 	    
 	    /* Close Display */
-	    rc = ddca_close_display(handle);
+	    rc = dev_close(dinfo, handle);
+	    bus_release(dinfo -> bus);
 	    if (rc!= 0) {
 	        error(rc);
 	    }
 	    
-	    return val.sl;
+	    return val.current;
 	}
 	
 	return -1;
@@ -393,39 +1555,151 @@ int ddc_get_brightness_percentage(int dispnum)
 }
 
 /**
- * sets brightness of selected display
+ * returns brightness of selected display or -1
+ */
+int ddc_get_brightness_percentage(Display_Id id)
+{
+	/* the user waits for this, only writes go first */
+	return read_brightness(id, BUS_READ);
+}
+
+/**
+ * returns brightness of selected display or -1, gives up when a user request needs the bus
+ */
+int ddc_prefetch_brightness_percentage(Display_Id id)
+{
+	return read_brightness(id, BUS_BACKGROUND);
+}
+
+/**
+ * gives back a feature read during discovery, returns 0 if the display has it
+ */
+int ddc_get_snapshot_value(Display_Id id, int vcp_code, Ddc_Value *value)
+{
+	Display_Info *dinfo = lookup(id);
+	if (dinfo == NULL)
+		return -1;
+
+	for (int i = 0; i < SNAPSHOT_SIZE; i++) {
+		if (snapshot_codes[i] == vcp_code && dinfo -> snapshot[i].current >= 0) {
+			*value = dinfo -> snapshot[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/**
+ * returns 1, if the selected display does not answer in time
  */
-void ddc_set_brightness_percentage(int dispnum, int value)
+int ddc_is_degraded(Display_Id id)
+{
+	Display_Info *dinfo = lookup(id);
+	if (dinfo == NULL)
+		return 0;
+	return is_degraded(dinfo);
+}
+
+/**
+ * sets function, that gets called when a display gets degraded or healthy again
+ */
+void ddc_register_state_callback(void (*callback)(Display_Id, int))
+{
+	state_callback = callback;
+}
+
+/**
+ * sets brightness of selected display, stale ids are ignored
+ */
+void ddc_set_brightness_percentage(Display_Id id, int value, unsigned int trace_id)
 {
 	/* everything has to be initialized first */
-	if (dispnum >= displaycount)
+	Display_Info *dinfo = lookup(id);
+	if (dinfo == NULL)
 		return;
 	
-	info[dispnum] -> wanted_brightness = value;
+	dinfo -> wanted_trace_id = trace_id;
+	dinfo -> wanted_brightness = value;
+	invalidate_brightness(dinfo);
+	note_request();
 	
 	/* wake up the thread, that handles brightness for this monitor */
-	pthread_cond_signal(&brightness_change_threads[dispnum] -> cond);
+	wake_worker(DISPLAY_ID_SLOT(id));
 
 }
 
 
 /**
- * set brightness for all displays
+ * parks all workers with closed handles, returns when they are parked or after SLEEP_QUIESCE_MS
  */
-void ddc_set_brightness_percentage_for_all(int value)
+void ddc_prepare_for_sleep()
 {
-	/* be save, everything is initialized */
-	if(displaycount < 1)
-		return;
+	__atomic_store_n(&suspended, true, __ATOMIC_RELAXED);
+	long deadline = now_ms() + SLEEP_QUIESCE_MS;
+	
+	for (int slot = 0; slot < MAX_DDC_DISPLAYS; slot++) {
+		Brightness_Thread *thread = brightness_change_threads[slot];
+		if (thread == NULL)
+			continue;
 		
-	for (int i = 0; i < displaycount; i++) {
-		info[i] -> wanted_brightness = value;
+		/* a worker, that hangs on its monitor, does not hold up the others for longer */
+		pthread_mutex_lock(&thread -> lock);
+		thread -> requests++;
+		pthread_cond_broadcast(&thread -> cond);
+		while (thread -> cont && !thread -> parked && now_ms() < deadline)
+			timed_wait(&thread -> cond, &thread -> lock, deadline - now_ms());
+		pthread_mutex_unlock(&thread -> lock);
+	}
+}
+
+/**
+ * lets the workers write the latest wanted brightness of their displays again, all at once
+ */
+void ddc_resume()
+{
+	__atomic_store_n(&suspended, false, __ATOMIC_RELAXED);
+	
+	for (int slot = 0; slot < MAX_DDC_DISPLAYS; slot++) {
+		Brightness_Thread *thread = brightness_change_threads[slot];
+		if (thread == NULL)
+			continue;
+		
+		/* monitors wake up with the system and may show anything now */
+		pthread_mutex_lock(&health_lock);
+		set_asleep(&table[slot], false);
+		table[slot].cached_at = 0;
+		pthread_mutex_unlock(&health_lock);
 		
-		/* wake up thread, that handles brightness for this monitor */
-		pthread_cond_signal(&brightness_change_threads[i] -> cond);
+		pthread_mutex_lock(&thread -> lock);
+		pthread_cond_broadcast(&thread -> cond);
+		pthread_mutex_unlock(&thread -> lock);
 	}
 }
 
+/**
+ * returns, how often the threads of ddcwrapper woke up since start
+ */
+unsigned long ddc_get_wakeup_count()
+{
+	return __atomic_load_n(&wakeups, __ATOMIC_RELAXED);
+}
+
+/**
+ * returns, how many transactions had to wait for another process, that held their bus
+ */
+unsigned long ddc_get_bus_contention_count()
+{
+	return __atomic_load_n(&bus_contentions, __ATOMIC_RELAXED);
+}
+
+/**
+ * returns, how many transactions went on without the lock of their bus, because another process kept it
+ */
+unsigned long ddc_get_bus_lock_timeout_count()
+{
+	return __atomic_load_n(&bus_lock_timeouts, __ATOMIC_RELAXED);
+}
+
 /**
  * cleans the heap up
  */
@@ -433,35 +1707,52 @@ void ddc_free()
 {
 	pthread_mutex_lock(&freemutex);
 	
-	/* end all threads */
-	for (int i = 0; i < displaycount; i++) {
-		brightness_change_threads[i] -> cont = false;
-		pthread_cond_signal(&brightness_change_threads[i] -> cond);
-		pthread_join(brightness_change_threads[i] -> id, NULL);
-
-		/* destroy mutex and conditional */	
-	    pthread_mutex_destroy(&brightness_change_threads[i] -> lock);
-    	pthread_cond_destroy(&brightness_change_threads[i] -> cond);
-    	free(brightness_change_threads[i]);
-    	
+	/* end watchdog */
+	if (watchdog_running) {
+		pthread_mutex_lock(&health_lock);
+		watchdog_running = false;
+		pthread_cond_signal(&health_cond);
+		pthread_mutex_unlock(&health_lock);
+		pthread_join(watchdog, NULL);
 	}
 	
-	/* free thread-array, the single structures are freed in the thread itself */
-	free(brightness_change_threads);
-	brightness_change_threads = NULL;
-	
-	/* free all display-infos */
-	for (int i = 0; i < displaycount; i++) {
-		free(info[i]);
+	/* end all threads and free their slots */
+	for (int slot = 0; slot < MAX_DDC_DISPLAYS; slot++) {
+		Brightness_Thread *thread = brightness_change_threads[slot];
+		if (thread != NULL) {
+			pthread_mutex_lock(&thread -> lock);
+			thread -> cont = false;
+			pthread_cond_signal(&thread -> cond);
+			pthread_mutex_unlock(&thread -> lock);
+			pthread_join(thread -> id, NULL);
+
+			/* destroy mutex and conditional */	
+		    pthread_mutex_destroy(&thread -> lock);
+	    	pthread_cond_destroy(&thread -> cond);
+	    	free(thread);
+	    	brightness_change_threads[slot] = NULL;
+		}
+		
+		if (table[slot].id != DISPLAY_ID_NONE)
+			remove_display(slot);
 	}
 	
-	/* free display-info-array */
-	free(info);
-	info = NULL;
+	/* all users of the buses are gone */
+	for (int i = 0; i < buscount; i++) {
+		if (buses[i].fd >= 0)
+			close(buses[i].fd);
+		pthread_mutex_destroy(&buses[i].lock);
+		pthread_cond_destroy(&buses[i].cond);
+	}
+	buscount = 0;
 	
-	/* free ddc_display_info_list */
-	ddca_free_display_info_list(zlist);
+	/* the backend forgets its displays */
+	if (backend != NULL)
+		backend -> free();
+	backend = NULL;
 	displaycount = -1;
 	
+	trace_close();
+	
 	pthread_mutex_unlock(&freemutex);
 }
@@ -20,30 +20,105 @@
 
 #pragma once
 
+#include "ddcbackend.h"
+#include "displayid.h"
+
+/* consecutive failures, that open the circuit breaker (the display gets degraded) */
+#define BREAKER_THRESHOLD 5
+
+/* the flock of a bus is not taken again before this gap (ms), so polling processes get their turn during back to back writes */
+#define BUS_LOCK_GAP_MS 2
+
+/**
+ * sets the backend, that talks to the monitors, before initializing
+ * a replayed trace (see ddctrace.h) takes its place
+ */
+void ddc_set_backend(const Ddc_Backend *backend);
+
 /**
  * initializes ddcci stuff and gives back the number of compatible displays to callback function
  */
 int ddc_count_displays_and_init();
 
 /**
- * returns the monitorname of selected display
+ * returns the id of the n-th display, displays are sorted by dispno
+ */
+Display_Id ddc_get_display_id(int n);
+
+/**
+ * returns the monitorname of selected display or NULL, if the id is stale
+ */
+char *ddc_get_display_name(Display_Id id);
+
+/**
+ * returns the i2c bus of selected display, negative if it is not on an i2c bus or the id is stale
+ */
+int ddc_get_bus_number(Display_Id id);
+
+/**
+ * returns brightness of selected display or -1
+ */
+int ddc_get_brightness_percentage(Display_Id id);
+
+/**
+ * returns brightness of selected display or -1, gives up when a user request needs the bus
+ */
+int ddc_prefetch_brightness_percentage(Display_Id id);
+
+/**
+ * gives back brightness (0x10), contrast (0x12) or power mode (0xd6) as read during discovery
+ * returns 0 if the display has the feature, without any bus traffic
+ */
+int ddc_get_snapshot_value(Display_Id id, int vcp_code, Ddc_Value *value);
+
+/**
+ * returns 1, if the selected display does not answer in time
+ */
+int ddc_is_degraded(Display_Id id);
+
+/**
+ * sets function, that gets called with display id and degraded state, when it changes
+ */
+void ddc_register_state_callback(void (*callback)(Display_Id, int));
+
+/**
+ * sets brightness of selected display, trace_id correlates tracepoints of this change
+ * stale ids are ignored
+ */
+void ddc_set_brightness_percentage(Display_Id id, int value, unsigned int trace_id);
+
+/**
+ * closes all handles and parks the workers before the system sleeps
+ * returns when they are parked, but waits at most two seconds for a hanging monitor
+ */
+void ddc_prepare_for_sleep();
+
+/**
+ * lets the workers write the latest brightness of every display again after the system resumed
+ */
+void ddc_resume();
+
+/**
+ * returns, for how many ms the oldest running ddc operation hangs, 0 if none runs
+ * it never touches a bus, so it answers even while all workers hang
  */
-char *ddc_get_display_name(int dispnum);
+long ddc_get_stalled_ms();
 
 /**
- * returns brightness of selected display to callback function
+ * returns, how often the threads of ddcwrapper woke up since start
+ * after 10 minutes without requests it stands still, until the next request
  */
-int ddc_get_brightness_percentage(int dispnum);
+unsigned long ddc_get_wakeup_count();
 
 /**
- * sets brightness of selected display
+ * returns, how many transactions had to wait for another process holding the flock of their bus
  */
-void ddc_set_brightness_percentage(int dispnum, int value);
+unsigned long ddc_get_bus_contention_count();
 
 /**
- * set brightness for all displays
+ * returns, how many transactions gave up waiting for the flock of their bus and went on without it
  */
-void ddc_set_brightness_percentage_for_all(int value);
+unsigned long ddc_get_bus_lock_timeout_count();
 
 /**
  * cleans the heap up
@@ -0,0 +1,62 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* size of the ddc display table */
+#define MAX_DDC_DISPLAYS 16
+
+/**
+ * identifies a display: the slot in the display table is stored in the lower
+ * 8 bits, the generation of that slot above. The generation of a ddc display
+ * is made from its edid, the one of a gamma dimmed output from its name, so
+ * ids of another monitor in the same slot are detected, even after the helper
+ * was restarted or the outputs were searched again.
+ */
+typedef uint32_t Display_Id;
+
+#define DISPLAY_ID_MAKE(slot, generation) ((Display_Id) (generation) << 8 | (slot))
+#define DISPLAY_ID_SLOT(id) ((id) & 0xff)
+#define DISPLAY_ID_GENERATION(id) ((id) >> 8)
+
+/* outputs without ddc, that are dimmed by their gamma ramps */
+#define MAX_GAMMA_DISPLAYS 8
+
+/* generations start at 1, so this id is never valid */
+#define DISPLAY_ID_NONE 0
+
+/* the internal display is handled by gnome-settings-daemon and outside of the table */
+#define DISPLAY_ID_INTERNAL DISPLAY_ID_MAKE(0xff, 1)
+
+/* gamma dimmed outputs are outside of the table as well, n is their slot in gammadisplayhandler.c */
+#define DISPLAY_ID_GAMMA(n, generation) DISPLAY_ID_MAKE(0xc0 + (n), generation)
+#define DISPLAY_ID_IS_GAMMA(id) (DISPLAY_ID_SLOT(id) >= 0xc0 && DISPLAY_ID_SLOT(id) < 0xc0 + MAX_GAMMA_DISPLAYS)
+#define DISPLAY_ID_GAMMA_INDEX(id) ((int) DISPLAY_ID_SLOT(id) - 0xc0)
+
+/**
+ * folds the identity of a display (a hash of its edid or name) into a generation, it is never 0
+ */
+static inline uint32_t display_id_generation(uint32_t identity)
+{
+	uint32_t generation = (identity ^ identity >> 24) & 0xffffff;
+	return generation != 0 ? generation : 1;
+}
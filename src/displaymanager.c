@@ -21,19 +21,34 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "displaymanager.h"
+#include "probes.h"
 
 typedef struct Brightness_Userdata {
-    int dispnum;
+    Display_Id id;
     void *old_userdata;
     void (*callback)(int, void*);
+    int prefetch;
 } Brightness_Userdata;
 
 static int has_internal = -1;
+
+/* guards the tables below, discovery replaces them, while the ui reads them */
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static int ddccount = 0;
+/* outputs of gammadisplayhandler.c, that are shown as displays of their own */
+static Display_Id gamma_ids[MAX_GAMMA_DISPLAYS];
+static int gammacount = 0;
 static pthread_mutex_t internal_ready_mutex;
 static pthread_cond_t internal_ready_cond;
 
+/* internal display and sleep watching are set up by the first discovery only */
+static int initialized = 0;
+/* outputs have to be searched again by the next discovery */
+static int rediscover = 0;
+
 /**
  * sets has_internal variable and wakes up thread, that tells ui thread displycount
  */
@@ -45,6 +60,62 @@ static void has_internal_callback(int has)
     pthread_mutex_unlock(&internal_ready_mutex);        
 }
 
+/**
+ * tells, if one of the first ddc displays is on the bus
+ */
+static int has_ddc_display(int busno, int ddc)
+{
+    for (int n = 0; n < ddc; n++)
+        if (helper_get_bus_number(helper_get_display_id(n)) == busno)
+            return 1;
+    return 0;
+}
+
+/**
+ * outputs on a bus without ddc display get dimmed by gamma instead, their ids go to ids
+ * if the bus is unknown, that is only safe without any ddc display
+ */
+static int find_gamma_displays(int slots, int ddc, Display_Id *ids)
+{
+    int count = 0;
+    
+    for (int i = 0; i < slots; i++) {
+        /* the generation comes from the name, so the id of another output in this slot is stale */
+        uint32_t identity = gamma_get_identity(i);
+        if (identity == 0)
+            continue;
+        int busno = gamma_get_bus_number(i);
+        if (busno < 0 ? ddc == 0 : !has_ddc_display(busno, ddc))
+            ids[count++] = DISPLAY_ID_GAMMA(i, display_id_generation(identity));
+    }
+    return count;
+}
+
+/**
+ * returns the slot of a gamma dimmed output, -1 if the id is stale
+ */
+static int gamma_slot_of(Display_Id id)
+{
+    int i = DISPLAY_ID_GAMMA_INDEX(id);
+    uint32_t identity = gamma_get_identity(i);
+    return identity != 0 && display_id_generation(identity) == DISPLAY_ID_GENERATION(id) ? i : -1;
+}
+
+/**
+ * returns the output on the bus of a ddc display, that dims it below its minimum, -1 if there is none
+ */
+static int dim_output_of(Display_Id id)
+{
+    int busno = helper_get_bus_number(id);
+    if (busno < 0)
+        return -1;
+    
+    for (int i = 0; i < GAMMA_MAX_OUTPUTS; i++)
+        if (gamma_get_bus_number(i) == busno)
+            return i;
+    return -1;
+}
+
 /**
  * async part of initializing
  */
@@ -52,15 +123,33 @@ static void count_displays_and_init_thread(void (*callback)(int))
 {
     /* initialize stuff */
     int displaycount = 0;
-    if (pthread_mutex_init(&internal_ready_mutex, NULL) != 0) {
-        fprintf(stderr, "Error initializing mutex\n");
-    }
-    if (pthread_cond_init(&internal_ready_cond, NULL) != 0) {
-        fprintf(stderr, "Error initializing conditional wait\n");
+    if (!initialized) {
+        if (pthread_mutex_init(&internal_ready_mutex, NULL) != 0) {
+            fprintf(stderr, "Error initializing mutex\n");
+        }
+        if (pthread_cond_init(&internal_ready_cond, NULL) != 0) {
+            fprintf(stderr, "Error initializing conditional wait\n");
+        }
+        
+        internal_init(has_internal_callback);
+        initialized = 1;
     }
-       
-    internal_init(has_internal_callback);
-    displaycount += ddc_count_displays_and_init();
+    
+    /* outputs may have been plugged in or out, the ones, that stay, keep their dimming */
+    int slots = __atomic_exchange_n(&rediscover, 0, __ATOMIC_ACQ_REL) ? gamma_rescan() : gamma_init();
+    
+    /* the ui reads the tables meanwhile, they are replaced at once */
+    Display_Id ids[MAX_GAMMA_DISPLAYS];
+    int ddc = helper_count_displays_and_init();
+    int gamma = find_gamma_displays(slots, ddc, ids);
+    
+    pthread_mutex_lock(&tables_lock);
+    ddccount = ddc;
+    memcpy(gamma_ids, ids, gamma * sizeof(Display_Id));
+    gammacount = gamma;
+    pthread_mutex_unlock(&tables_lock);
+    
+    displaycount += ddc + gamma;
     
     /* waits for proxy callback to figure out, if there is an internal display */
     pthread_mutex_lock(&internal_ready_mutex);
@@ -86,6 +175,9 @@ void count_displays_and_init(void (*callback)(int))
     pthread_t id;
     int status;
     
+    /* ddc displays are left alone while the system sleeps, gamma ramps and gnome-settings-daemon do not care */
+    sleep_watch_init(helper_set_sleeping);
+    
     status = pthread_create(&id, NULL, (void*) count_displays_and_init_thread, callback);
     if (status != 0) {
         fprintf(stderr, "Error creating thread: %d\n", status);
@@ -93,20 +185,102 @@ void count_displays_and_init(void (*callback)(int))
 }
 
 /**
- * returns the monitorname of selected display
+ * lets the next count_displays_and_init search for monitors again, after they were plugged in or out
  */
-char *get_display_name(int dispnum)
+void rediscover_displays()
+{
+    __atomic_store_n(&rediscover, 1, __ATOMIC_RELEASE);
+    helper_request_rediscovery();
+}
+
+/**
+ * sets function, that gets called from another thread, when the displays may have changed by themselves
+ * count_displays_and_init tells the current ones then
+ */
+void register_displays_callback(void (*callback)())
+{
+    helper_register_displays_callback(callback);
+}
+
+/**
+ * returns the id of the n-th display, the internal display comes first, gamma dimmed outputs last
+ */
+Display_Id get_display_id(int n)
 {
     if (has_internal == 1) {
-        /* return "Internal" if there is an internal display */
-        if (dispnum == 0)
-            return "Internal";
-        /* the ddcwrapper indizies have to be reduced by one */
-        return ddc_get_display_name(dispnum - 1);
+        if (n == 0)
+            return DISPLAY_ID_INTERNAL;
+        n--;
     }
     
-    /* this is the default case, if there is no internal display */
-    return ddc_get_display_name(dispnum);
+    pthread_mutex_lock(&tables_lock);
+    int ddc = ddccount;
+    Display_Id id = n >= ddc && n - ddc < gammacount ? gamma_ids[n - ddc] : DISPLAY_ID_NONE;
+    pthread_mutex_unlock(&tables_lock);
+    
+    return n < ddc ? helper_get_display_id(n) : id;
+}
+
+/**
+ * copies the monitorname of selected display, returns -1 if the id is stale
+ */
+int get_display_name(Display_Id id, char *name, size_t size)
+{
+    /* return "Internal" if there is an internal display */
+    if (id == DISPLAY_ID_INTERNAL) {
+        snprintf(name, size, "%s", "Internal");
+        return 0;
+    }
+    if (DISPLAY_ID_IS_GAMMA(id)) {
+        int i = gamma_slot_of(id);
+        return i >= 0 ? gamma_get_name(i, name, size) : -1;
+    }
+    
+    return helper_get_display_name(id, name, size);
+}
+
+/**
+ * returns the lowest brightness of selected display, below 0 the output gets dimmed by gamma
+ */
+int get_minimum_brightness(Display_Id id)
+{
+    if (id == DISPLAY_ID_INTERNAL || DISPLAY_ID_IS_GAMMA(id))
+        return 0;
+    return dim_output_of(id) >= 0 ? -GAMMA_DIM_RANGE : 0;
+}
+
+/**
+ * turns the -1 of a failed read into BRIGHTNESS_UNKNOWN
+ */
+static int known(int percentage)
+{
+    return percentage < 0 ? BRIGHTNESS_UNKNOWN : percentage;
+}
+
+/**
+ * reads a ddc display, at its minimum the gamma dimming of its output counts below 0
+ */
+static int get_ddc_brightness(Display_Id id, int prefetch)
+{
+    int percentage = known(prefetch ? helper_prefetch_brightness_percentage(id) : helper_get_brightness_percentage(id));
+    if (percentage == BRIGHTNESS_UNKNOWN)
+        return BRIGHTNESS_UNKNOWN;
+    
+    int output = dim_output_of(id);
+    if (percentage == 0 && output >= 0)
+        return (gamma_get_brightness(output) - 100) * GAMMA_DIM_RANGE / 100;
+    return percentage;
+}
+
+/**
+ * sets a ddc display, values below 0 keep it at its minimum and dim its output
+ */
+static void set_ddc_brightness(Display_Id id, int value, unsigned int trace_id)
+{
+    int output = dim_output_of(id);
+    if (output >= 0)
+        gamma_set_brightness(output, value < 0 ? 100 + value * 100 / GAMMA_DIM_RANGE : 100);
+    helper_set_brightness_percentage(id, value < 0 ? 0 : value, trace_id);
 }
 
 /**
@@ -117,100 +291,121 @@ static void get_brightness_percentage_thread(void *userdata)
     /* unpack userdata for getting percentage */
     Brightness_Userdata *data = userdata;
     
-    int dispnum = data -> dispnum;
+    Display_Id id = data -> id;
     void (*callback)(int, void*) = data -> callback;
     void *old_userdata = data -> old_userdata;
+    int prefetch = data -> prefetch;
     
     free(data);
     
     /* call ddc function and call its return value back to callback */
     int percentage;
     
-    if (has_internal && dispnum == 0)
-        percentage = internal_get_brightness();
+    if (id == DISPLAY_ID_INTERNAL)
+        percentage = known(internal_get_brightness());
+    else if (DISPLAY_ID_IS_GAMMA(id))
+        percentage = known(gamma_get_brightness(gamma_slot_of(id)));
     else
-        percentage = ddc_get_brightness_percentage(dispnum);
+        percentage = get_ddc_brightness(id, prefetch);
     
     callback(percentage, old_userdata);
     
 }
 
 /**
- * returns brightness of selected display to callback function
+ * starts a thread, that reads the brightness and calls it back
  */
-void get_brightness_percentage(int dispnum, void* userdata, void (*callback)(int, void*))
+static void read_brightness(Display_Id id, void* userdata, void (*callback)(int, void*), int prefetch)
 {
     /* user data for brightness threads */
     Brightness_Userdata *data = malloc(sizeof(Brightness_Userdata));
     int status;
-    pthread_t id;
-    
-    if (has_internal && dispnum != 0) {
-        dispnum--;
-    }
+    pthread_t thread;
     
-    data -> dispnum = dispnum;
+    data -> id = id;
     data -> old_userdata = userdata;
     data -> callback = callback;
+    data -> prefetch = prefetch;
     
-    status = pthread_create(&id, NULL, (void*) get_brightness_percentage_thread, data);
+    status = pthread_create(&thread, NULL, (void*) get_brightness_percentage_thread, data);
     if (status != 0) {
         fprintf(stderr, "Error creating thread: %d\n", status);
     }
 }
 
+/**
+ * returns brightness of selected display to callback function
+ */
+void get_brightness_percentage(Display_Id id, void* userdata, void (*callback)(int, void*))
+{
+    read_brightness(id, userdata, callback, 0);
+}
+
+/**
+ * like get_brightness_percentage, but ddc displays are read in the background
+ * the read gives up with BRIGHTNESS_UNKNOWN, when a user request needs the bus
+ */
+void prefetch_brightness_percentage(Display_Id id, void* userdata, void (*callback)(int, void*))
+{
+    read_brightness(id, userdata, callback, 1);
+}
+
 /**
  * register a scale, so its value can be changed, if brightness gets changed from another place
  * returns 1 if scale can be registered
  */
-void register_scale(void *scale, int index, void (*callback)(int, void*))
+void register_scale(void *scale, Display_Id id, void (*callback)(int, void*))
 {
-    if (has_internal == 1) {
-        if (index == 0) {
-            internal_register_scale(scale, callback);
-        } else
-            index--;
-    }
+    if (id == DISPLAY_ID_INTERNAL)
+        internal_register_scale(scale, callback);
     
     /* TODO: also detect brightness change at ddc interface */
 }
 
 /**
- * tells, if the scale is updated by dbus signal
+ * sets function, that gets called with display id and degraded state, when a monitor stops or starts answering
  */
-int is_self_updated(int dispnum) 
+void register_state_callback(void (*callback)(Display_Id, int))
 {
-    if (has_internal && dispnum == 0)
-        return 1;
-    return 0;
+    /* ids need no translation, the internal display never gets degraded */
+    helper_register_state_callback(callback);
 }
 
 /**
- * sets brightness of selected display
+ * tells, if the monitor does not answer in time
  */
-void set_brightness_percentage(int dispnum, int value)
+int is_degraded(Display_Id id)
 {
-    if (has_internal == 1) {
-        if (dispnum == 0) {
-            internal_set_brightness(value);
-            return;
-        } else {
-            dispnum--;
-        }
-    }
-    ddc_set_brightness_percentage(dispnum, value);
-    
-   
+    /* internal display is handled by gnome-settings-daemon */
+    if (id == DISPLAY_ID_INTERNAL || DISPLAY_ID_IS_GAMMA(id))
+        return 0;
+    return helper_is_degraded(id);
 }
 
 /**
- * set brightness for all displays
+ * tells, if the scale is updated by dbus signal
  */
-void set_brightness_percentage_for_all(int value)
+int is_self_updated(Display_Id id) 
 {
-    if (has_internal == 1)
-        internal_set_brightness(value);
-    ddc_set_brightness_percentage_for_all(value);
+    return id == DISPLAY_ID_INTERNAL;
+}
+
+/**
+ * sets brightness of selected display, stale ids are ignored
+ */
+void set_brightness_percentage(Display_Id id, int value, unsigned int trace_id)
+{
+    PROBE(dispatch, trace_id, id, value);
+    
+    if (id == DISPLAY_ID_INTERNAL) {
+        internal_set_brightness(value, trace_id);
+        return;
+    }
+    if (DISPLAY_ID_IS_GAMMA(id)) {
+        gamma_set_brightness(gamma_slot_of(id), value);
+        return;
+    }
+    set_ddc_brightness(id, value, trace_id);
 }
 
 /**
@@ -218,7 +413,11 @@ void set_brightness_percentage_for_all(int value)
  */
 void clear_all()
 {
+    sleep_watch_destroy();
     if (has_internal == 1)
         internal_destroy();
-    ddc_free();
+    helper_free();
+    gamma_destroy();
+    has_internal = -1;
+    initialized = 0;
 }
@@ -20,8 +20,19 @@
  
 #pragma once
 
-#include "ddcwrapper.h"
+#include "gammadisplayhandler.h"
+#include "helperclient.h"
 #include "internaldisplayhandler.h"
+#include "sleepwatcher.h"
+
+/* brightness callbacks get this, if a monitor could not be read, it is below every slider */
+#define BRIGHTNESS_UNKNOWN -1000
+
+/* ddc monitors, whose output can be dimmed by gamma, go this far below 0 */
+#define GAMMA_DIM_RANGE 50
+
+/* longest name of a display (including \0) */
+#define DISPLAY_NAME_SIZE 64
 
 
 /**
@@ -30,34 +41,68 @@
 void count_displays_and_init(void (*callback)(int));
 
 /**
- * returns the monitorname of selected display
+ * lets the next count_displays_and_init search for monitors again, after they were plugged in or out
+ */
+void rediscover_displays();
+
+/**
+ * sets function, that gets called from another thread, when the displays may have changed by themselves
+ * count_displays_and_init tells the current ones then
+ */
+void register_displays_callback(void (*callback)());
+
+/**
+ * returns the id of the n-th display, the internal display comes first, gamma dimmed outputs last
+ */
+Display_Id get_display_id(int n);
+
+/**
+ * copies the monitorname of selected display into name, returns -1 if the id is stale
  */
-char *get_display_name(int dispnum);
+int get_display_name(Display_Id id, char *name, size_t size);
 
 /**
- * returns brightness of selected display to callback function
+ * returns the lowest brightness of selected display, below 0 the output gets dimmed by gamma
  */
-void get_brightness_percentage(int dispnum, void *userdata, void (*callback)(int, void*));
+int get_minimum_brightness(Display_Id id);
+
+/**
+ * returns brightness of selected display to callback function, BRIGHTNESS_UNKNOWN on failure
+ */
+void get_brightness_percentage(Display_Id id, void *userdata, void (*callback)(int, void*));
+
+/**
+ * like get_brightness_percentage, but ddc displays are read in the background
+ * the read gives up with BRIGHTNESS_UNKNOWN, when a user request needs the bus
+ */
+void prefetch_brightness_percentage(Display_Id id, void *userdata, void (*callback)(int, void*));
 
 /**
  * register a scale, so its value can be changed, if brightness gets changed from another place
  */
-void register_scale(void *scale, int index, void (*callback)(int, void*));
+void register_scale(void *scale, Display_Id id, void (*callback)(int, void*));
 
 /**
- * tells, if the scale is updated by dbus signal
+ * sets function, that gets called with display id and degraded state, when a monitor stops or starts answering
+ * it is called from another thread
  */
-int is_self_updated(int dispnum);
+void register_state_callback(void (*callback)(Display_Id, int));
 
 /**
- * sets brightness of selected display
+ * tells, if the monitor does not answer in time
+ */
+int is_degraded(Display_Id id);
+
+/**
+ * tells, if the scale is updated by dbus signal
  */
-void set_brightness_percentage(int dispnum, int value);
+int is_self_updated(Display_Id id);
 
 /**
- * set brightness for all displays
+ * sets brightness of selected display, trace_id correlates tracepoints of this change
+ * stale ids are ignored
  */
-void set_brightness_percentage_for_all(int value);
+void set_brightness_percentage(Display_Id id, int value, unsigned int trace_id);
 
 /**
  * everything
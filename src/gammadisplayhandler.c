@@ -0,0 +1,462 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ddcbackend.h"
+#include "gammadisplayhandler.h"
+
+/* the darkest level keeps this much of the undimmed ramp (permille), so the screen never goes black */
+#define GAMMA_MIN_PERMILLE 200
+
+#define DRM_PATH "/sys/class/drm"
+
+/* an output and the ramps of its crtc, the slot is free without base */
+typedef struct Gamma_Output {
+    RRCrtc crtc;
+    char name[GAMMA_NAME_SIZE];
+    uint32_t identity;      /* hash of the name */
+    int busno;
+    int level;
+    int seen;               /* found by the running scan */
+    XRRCrtcGamma *base;     /* the ramp without dimming, as set by whoever else owns the crtc (Night Light, calibration) */
+    XRRCrtcGamma *ramp;     /* the ramp this handler wrote last, refilled for every level */
+} Gamma_Output;
+
+static Display *xdisplay = NULL;
+static Gamma_Output outputs[GAMMA_MAX_OUTPUTS];
+/* slots below this may be in use */
+static int outputcount = 0;
+
+/* 16 bit fixed point factor of every level, filled once */
+static uint32_t factors[101];
+
+/* serializes everything, that talks to the X server */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * internal panels are handled by gnome-settings-daemon
+ */
+static int is_internal(const char *name)
+{
+    return strncmp(name, "eDP", 3) == 0 || strncmp(name, "LVDS", 4) == 0 || strncmp(name, "DSI", 3) == 0;
+}
+
+/**
+ * tells, if the drm connector directory (card0-HDMI-A-1) belongs to the XRandR output name (HDMI-1)
+ */
+static int is_connector_of(const char *connector, const char *name)
+{
+    /* skip cardN- */
+    const char *dash = strchr(connector, '-');
+    if (strncmp(connector, "card", 4) != 0 || dash == NULL)
+        return 0;
+    connector = dash + 1;
+    
+    /* the modesetting driver calls HDMI-A just HDMI */
+    if (strncmp(connector, "HDMI-A-", 7) == 0 && strncmp(name, "HDMI-", 5) == 0)
+        return strcmp(connector + 7, name + 5) == 0;
+    return strcmp(connector, name) == 0;
+}
+
+/**
+ * reads the bus number from an entry like i2c-4, -1 if it is none
+ */
+static int parse_bus(const char *entry)
+{
+    int busno;
+    char rest;
+    if (sscanf(entry, "i2c-%d%c", &busno, &rest) != 1)
+        return -1;
+    return busno;
+}
+
+/**
+ * returns the i2c bus of the connector of an output, -1 if sysfs does not know it
+ * it is the ddc link for most connectors and the aux channel for DisplayPort
+ */
+static int find_bus(const char *name)
+{
+    DIR *drm = opendir(DRM_PATH);
+    struct dirent *entry;
+    int busno = -1;
+    
+    if (drm == NULL)
+        return -1;
+    
+    while (busno < 0 && (entry = readdir(drm)) != NULL) {
+        if (!is_connector_of(entry -> d_name, name))
+            continue;
+        
+        char path[PATH_MAX];
+        char link[PATH_MAX];
+        snprintf(path, sizeof(path), DRM_PATH "/%s/ddc", entry -> d_name);
+        ssize_t len = readlink(path, link, sizeof(link) - 1);
+        if (len > 0) {
+            link[len] = '\0';
+            char *base = strrchr(link, '/');
+            busno = parse_bus(base != NULL ? base + 1 : link);
+        }
+        
+        if (busno < 0) {
+            snprintf(path, sizeof(path), DRM_PATH "/%s", entry -> d_name);
+            DIR *connector = opendir(path);
+            struct dirent *inner;
+            while (connector != NULL && busno < 0 && (inner = readdir(connector)) != NULL)
+                busno = parse_bus(inner -> d_name);
+            if (connector != NULL)
+                closedir(connector);
+        }
+    }
+    
+    closedir(drm);
+    return busno;
+}
+
+/**
+ * copies the values of ramp from into ramp to of the same size
+ */
+static void copy_ramp(XRRCrtcGamma *to, XRRCrtcGamma *from)
+{
+    size_t len = from -> size * sizeof(unsigned short);
+    memcpy(to -> red, from -> red, len);
+    memcpy(to -> green, from -> green, len);
+    memcpy(to -> blue, from -> blue, len);
+}
+
+/**
+ * tells, if two ramps are the same
+ */
+static int is_same_ramp(XRRCrtcGamma *a, XRRCrtcGamma *b)
+{
+    size_t len = a -> size * sizeof(unsigned short);
+    return a -> size == b -> size &&
+           memcmp(a -> red, b -> red, len) == 0 &&
+           memcmp(a -> green, b -> green, len) == 0 &&
+           memcmp(a -> blue, b -> blue, len) == 0;
+}
+
+/**
+ * reads the current ramp of an output, if someone else replaced the ramp written last,
+ * that one is the new base and the output is not dimmed anymore
+ * has to be called with lock held
+ */
+static void refresh_base(Gamma_Output *output)
+{
+    XRRCrtcGamma *current = XRRGetCrtcGamma(xdisplay, output -> crtc);
+    if (current == NULL)
+        return;
+    
+    if (is_same_ramp(current, output -> ramp)) {
+        XRRFreeGamma(current);
+        return;
+    }
+    
+    if (current -> size != output -> ramp -> size) {
+        XRRFreeGamma(output -> ramp);
+        output -> ramp = XRRAllocGamma(current -> size);
+    }
+    copy_ramp(output -> ramp, current);
+    XRRFreeGamma(output -> base);
+    output -> base = current;
+    output -> level = 100;
+}
+
+/**
+ * tells, if a slot holds an output
+ */
+static int is_used(int i)
+{
+    return i >= 0 && i < outputcount && outputs[i].base != NULL;
+}
+
+/**
+ * remembers an output in a free slot, mirrored outputs share their crtc and are only added once
+ * has to be called with lock held
+ */
+static void add_output(RRCrtc crtc, const char *name)
+{
+    int slot = -1;
+    for (int i = GAMMA_MAX_OUTPUTS - 1; i >= 0; i--) {
+        if (is_used(i) && outputs[i].crtc == crtc)
+            return;
+        if (!is_used(i))
+            slot = i;
+    }
+    if (slot < 0)
+        return;
+    
+    int size = XRRGetCrtcGammaSize(xdisplay, crtc);
+    if (size <= 0)
+        return;
+    
+    XRRCrtcGamma *base = XRRGetCrtcGamma(xdisplay, crtc);
+    if (base == NULL)
+        return;
+    
+    Gamma_Output *output = &outputs[slot];
+    output -> crtc = crtc;
+    strncpy(output -> name, name, GAMMA_NAME_SIZE - 1);
+    output -> name[GAMMA_NAME_SIZE - 1] = '\0';
+    output -> identity = ddc_hash(output -> name, strlen(output -> name), DDC_HASH_INIT);
+    output -> busno = find_bus(name);
+    output -> level = 100;
+    output -> seen = 1;
+    output -> base = base;
+    output -> ramp = XRRAllocGamma(base -> size);
+    copy_ramp(output -> ramp, base);
+    if (slot >= outputcount)
+        outputcount = slot + 1;
+}
+
+/**
+ * forgets the output of a slot, its undimmed ramp is restored, if its crtc still exists
+ * has to be called with lock held
+ */
+static void remove_output(int i, XRRScreenResources *res)
+{
+    Gamma_Output *output = &outputs[i];
+    
+    for (int j = 0; res != NULL && j < res -> ncrtc; j++) {
+        if (res -> crtcs[j] != output -> crtc)
+            continue;
+        refresh_base(output);
+        if (output -> level != 100)
+            XRRSetCrtcGamma(xdisplay, output -> crtc, output -> base);
+    }
+    
+    XRRFreeGamma(output -> base);
+    XRRFreeGamma(output -> ramp);
+    output -> base = NULL;
+    output -> ramp = NULL;
+}
+
+/**
+ * brings the slots in line with the connected external outputs, outputs, that stay
+ * on their crtc, keep their slot, ramps and dimming, gone ones are restored
+ * has to be called with lock held
+ */
+static void scan_outputs()
+{
+    XRRScreenResources *res = XRRGetScreenResourcesCurrent(xdisplay, DefaultRootWindow(xdisplay));
+    XRROutputInfo *found[GAMMA_MAX_OUTPUTS];
+    int count = 0;
+    
+    for (int i = 0; res != NULL && i < res -> noutput && count < GAMMA_MAX_OUTPUTS; i++) {
+        XRROutputInfo *info = XRRGetOutputInfo(xdisplay, res, res -> outputs[i]);
+        if (info == NULL)
+            continue;
+        if (info -> connection == RR_Connected && info -> crtc != None && !is_internal(info -> name))
+            found[count++] = info;
+        else
+            XRRFreeOutputInfo(info);
+    }
+    
+    for (int i = 0; i < outputcount; i++) {
+        outputs[i].seen = 0;
+        for (int j = 0; is_used(i) && j < count; j++)
+            if (outputs[i].crtc == found[j] -> crtc && strncmp(outputs[i].name, found[j] -> name, GAMMA_NAME_SIZE - 1) == 0)
+                outputs[i].seen = 1;
+    }
+    
+    /* before new outputs take the crtcs of the gone ones */
+    for (int i = 0; i < outputcount; i++)
+        if (is_used(i) && !outputs[i].seen)
+            remove_output(i, res);
+    
+    for (int j = 0; j < count; j++) {
+        add_output(found[j] -> crtc, found[j] -> name);
+        XRRFreeOutputInfo(found[j]);
+    }
+    
+    while (outputcount > 0 && !is_used(outputcount - 1))
+        outputcount--;
+    
+    if (res != NULL)
+        XRRFreeScreenResources(res);
+}
+
+/**
+ * finds connected external outputs via XRandR and remembers their current gamma ramps
+ */
+int gamma_init()
+{
+    pthread_mutex_lock(&lock);
+    if (xdisplay != NULL) {
+        pthread_mutex_unlock(&lock);
+        return outputcount;
+    }
+    
+    for (int level = 0; level <= 100; level++)
+        factors[level] = (GAMMA_MIN_PERMILLE + (1000 - GAMMA_MIN_PERMILLE) * level / 100) * 65536 / 1000;
+    
+    int event_base, error_base;
+    xdisplay = XOpenDisplay(NULL);
+    if (xdisplay == NULL || !XRRQueryExtension(xdisplay, &event_base, &error_base)) {
+        fprintf(stderr, "No XRandR, gamma dimming is not available\n");
+        if (xdisplay != NULL)
+            XCloseDisplay(xdisplay);
+        xdisplay = NULL;
+        pthread_mutex_unlock(&lock);
+        return 0;
+    }
+    
+    scan_outputs();
+    
+    pthread_mutex_unlock(&lock);
+    return outputcount;
+}
+
+/**
+ * searches the outputs again after they were plugged in or out
+ */
+int gamma_rescan()
+{
+    pthread_mutex_lock(&lock);
+    if (xdisplay == NULL) {
+        pthread_mutex_unlock(&lock);
+        return gamma_init();
+    }
+    
+    scan_outputs();
+    int count = outputcount;
+    pthread_mutex_unlock(&lock);
+    return count;
+}
+
+/**
+ * copies the name of the output in slot i, returns -1 if the slot is free
+ */
+int gamma_get_name(int i, char *name, size_t size)
+{
+    pthread_mutex_lock(&lock);
+    int used = is_used(i);
+    if (used)
+        snprintf(name, size, "%s", outputs[i].name);
+    pthread_mutex_unlock(&lock);
+    return used ? 0 : -1;
+}
+
+/**
+ * returns the hash of the name of the output in slot i, 0 if the slot is free
+ */
+uint32_t gamma_get_identity(int i)
+{
+    pthread_mutex_lock(&lock);
+    uint32_t identity = is_used(i) ? outputs[i].identity : 0;
+    pthread_mutex_unlock(&lock);
+    return identity;
+}
+
+/**
+ * returns the i2c bus of the connector of the output in slot i, -1 if it is unknown
+ */
+int gamma_get_bus_number(int i)
+{
+    pthread_mutex_lock(&lock);
+    int busno = is_used(i) ? outputs[i].busno : -1;
+    pthread_mutex_unlock(&lock);
+    return busno;
+}
+
+/**
+ * returns the brightness level of the output in slot i
+ */
+int gamma_get_brightness(int i)
+{
+    pthread_mutex_lock(&lock);
+    if (xdisplay != NULL && is_used(i))
+        refresh_base(&outputs[i]);
+    int level = is_used(i) ? outputs[i].level : -1;
+    pthread_mutex_unlock(&lock);
+    return level;
+}
+
+/**
+ * dims the output in slot i, the ramp is scaled from the current base, so calibration and Night Light are kept
+ */
+void gamma_set_brightness(int i, int percentage)
+{
+    if (percentage < 0)
+        percentage = 0;
+    if (percentage > 100)
+        percentage = 100;
+    
+    pthread_mutex_lock(&lock);
+    if (!is_used(i)) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    Gamma_Output *output = &outputs[i];
+    if (xdisplay != NULL)
+        refresh_base(output);
+    if (xdisplay != NULL && output -> level != percentage) {
+        uint32_t factor = factors[percentage];
+        XRRCrtcGamma *from = output -> base;
+        XRRCrtcGamma *to = output -> ramp;
+        
+        for (int j = 0; j < to -> size; j++) {
+            to -> red[j] = from -> red[j] * factor >> 16;
+            to -> green[j] = from -> green[j] * factor >> 16;
+            to -> blue[j] = from -> blue[j] * factor >> 16;
+        }
+        XRRSetCrtcGamma(xdisplay, output -> crtc, to);
+        XFlush(xdisplay);
+        output -> level = percentage;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * restores the undimmed ramps and closes the connection
+ * ramps, that someone else replaced meanwhile, are left alone
+ */
+void gamma_destroy()
+{
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < outputcount; i++) {
+        if (!is_used(i))
+            continue;
+        refresh_base(&outputs[i]);
+        if (outputs[i].level != 100)
+            XRRSetCrtcGamma(xdisplay, outputs[i].crtc, outputs[i].base);
+        XRRFreeGamma(outputs[i].base);
+        XRRFreeGamma(outputs[i].ramp);
+        outputs[i].base = NULL;
+        outputs[i].ramp = NULL;
+    }
+    outputcount = 0;
+    
+    if (xdisplay != NULL) {
+        XSync(xdisplay, False);
+        XCloseDisplay(xdisplay);
+    }
+    xdisplay = NULL;
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,75 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "displayid.h"
+
+/* outputs, whose gamma ramps are handled */
+#define GAMMA_MAX_OUTPUTS MAX_GAMMA_DISPLAYS
+
+/* maximum length of an output name (including \0) */
+#define GAMMA_NAME_SIZE 32
+
+/**
+ * finds connected external outputs via XRandR and remembers their gamma ramps, every output gets a slot
+ * returns the number of slots, some of them may be free, 0 if there is no X server with RandR
+ */
+int gamma_init();
+
+/**
+ * searches the outputs again after they were plugged in or out, returns the number of slots
+ * outputs, that stay, keep their slot and dimming, gone ones get their undimmed ramps back
+ */
+int gamma_rescan();
+
+/**
+ * copies the name of the output in slot i, like HDMI-1, returns -1 if the slot is free
+ */
+int gamma_get_name(int i, char *name, size_t size);
+
+/**
+ * returns a hash of the name of the output in slot i, 0 if the slot is free
+ */
+uint32_t gamma_get_identity(int i);
+
+/**
+ * returns the i2c bus of the connector of the output in slot i, -1 if it is unknown or the slot is free
+ */
+int gamma_get_bus_number(int i);
+
+/**
+ * returns the brightness level of the output in slot i, -1 if the slot is free
+ */
+int gamma_get_brightness(int i);
+
+/**
+ * dims the output in slot i by scaling its current gamma ramps, changes of others like Night Light are kept
+ * 100 keeps them untouched, 0 is the darkest level, that still shows something
+ */
+void gamma_set_brightness(int i, int percentage);
+
+/**
+ * restores the undimmed gamma ramps and closes the connection
+ */
+void gamma_destroy();
@@ -0,0 +1,317 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * budgie-monitor-brightness-helper
+ *
+ * Runs all ddcutil work outside of budgie-panel. The applet spawns this
+ * process with one end of a SOCK_SEQPACKET socketpair as fd 0 and talks
+ * to it with Helper_Message packets (see helperprotocol.h).
+ * The main loop never touches I²C, so it can always answer pings.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "clicommand.h"
+#include "ddctrace.h"
+#include "ddcutilbackend.h"
+#include "ddcwrapper.h"
+#include "helperprotocol.h"
+#include "probes.h"
+#include "standalone.h"
+#include "topology.h"
+
+#define SOCKET_FD 0
+
+/* number of displays, -1 as long as discovery is not finished */
+static int displaycount = -1;
+
+/* brightness values that arrive before discovery is finished, indexed by slot of their display id */
+static Display_Id early_displays[HELPER_MAX_DISPLAYS];
+static int early_targets[HELPER_MAX_DISPLAYS];
+static unsigned int early_trace_ids[HELPER_MAX_DISPLAYS];
+
+/* guards displaycount and early_targets */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * sends a message back to the applet
+ */
+static void reply(Helper_Message *msg)
+{
+	if (send(SOCKET_FD, msg, sizeof(Helper_Message), MSG_NOSIGNAL) < 0)
+		perror("Error sending reply");
+}
+
+/**
+ * runs fn with a copy of msg in a detached thread
+ */
+static void run_detached(void (*fn)(void*), Helper_Message *msg)
+{
+	pthread_t id;
+	int status;
+
+	Helper_Message *copy = malloc(sizeof(Helper_Message));
+	*copy = *msg;
+
+	if ((status = pthread_create(&id, NULL, (void*) fn, copy)) != 0) {
+		fprintf(stderr, "Error creating thread: %d\n", status);
+		free(copy);
+		return;
+	}
+	pthread_detach(id);
+}
+
+/**
+ * stores the found displays, so the command line client finds them without discovery
+ */
+static void save_topology(int count)
+{
+	Topology_Entry entries[HELPER_MAX_DISPLAYS];
+	int n = 0;
+
+	/* a replayed trace has no real monitors */
+	if (trace_is_replaying())
+		return;
+
+	for (int i = 0; i < count; i++) {
+		Display_Id id = ddc_get_display_id(i);
+		char *name = ddc_get_display_name(id);
+		int busno = ddc_get_bus_number(id);
+		if (name == NULL || busno < 0)
+			continue;
+
+		entries[n].busno = busno;
+		strncpy(entries[n].name, name, TOPOLOGY_NAME_SIZE - 1);
+		entries[n].name[TOPOLOGY_NAME_SIZE - 1] = '\0';
+		n++;
+	}
+
+	topology_write(entries, n);
+}
+
+/**
+ * discovery thread, applies brightness values that came in meanwhile
+ */
+static void init_thread(void *val)
+{
+	Helper_Message *msg = val;
+
+	int count = ddc_count_displays_and_init();
+	if (count > HELPER_MAX_DISPLAYS)
+		count = HELPER_MAX_DISPLAYS;
+
+	pthread_mutex_lock(&lock);
+	displaycount = count;
+	for (int i = 0; i < HELPER_MAX_DISPLAYS; i++) {
+		if (early_targets[i] != -1) {
+			/* ids of displays, that are gone now, are ignored */
+			ddc_set_brightness_percentage(early_displays[i], early_targets[i], early_trace_ids[i]);
+			early_targets[i] = -1;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	msg -> value = count;
+	reply(msg);
+	free(msg);
+
+	save_topology(count);
+}
+
+/**
+ * reads brightness in its own thread, so a slow monitor does not block the main loop
+ */
+static void get_brightness_thread(void *val)
+{
+	Helper_Message *msg = val;
+
+	if (msg -> value == 1)
+		msg -> value = ddc_prefetch_brightness_percentage(msg -> display);
+	else
+		msg -> value = ddc_get_brightness_percentage(msg -> display);
+	reply(msg);
+	free(msg);
+}
+
+/**
+ * parks the workers before the system sleeps or wakes them after it resumed
+ * the reply tells the applet, that the monitors are left alone
+ */
+static void sleep_thread(void *val)
+{
+	Helper_Message *msg = val;
+
+	if (msg -> value)
+		ddc_prepare_for_sleep();
+	else
+		ddc_resume();
+	reply(msg);
+	free(msg);
+}
+
+/**
+ * tells the applet, that a display got degraded or healthy again
+ */
+static void state_changed(Display_Id display, int degraded)
+{
+	Helper_Message msg = { .op = HELPER_OP_STATE, .display = display, .value = degraded };
+	reply(&msg);
+}
+
+/**
+ * returns a counter of ddcwrapper, -1 for an unknown one
+ */
+static int32_t stat_of(int32_t stat)
+{
+	switch (stat) {
+	case HELPER_STAT_WAKEUPS:
+		return ddc_get_wakeup_count();
+	case HELPER_STAT_BUS_CONTENTIONS:
+		return ddc_get_bus_contention_count();
+	case HELPER_STAT_BUS_LOCK_TIMEOUTS:
+		return ddc_get_bus_lock_timeout_count();
+	default:
+		return -1;
+	}
+}
+
+/**
+ * returns true after discovery, ids are checked by ddcwrapper itself
+ */
+static bool is_discovered()
+{
+	return displaycount != -1;
+}
+
+int main(int argc, char **argv)
+{
+	Helper_Message msg;
+	ssize_t len;
+
+	/* started by the command line client without applet, see cli.c */
+	if (argc > 1) {
+		Command command;
+		int display, value, status;
+
+		if ((status = parse_command(argc, argv, &command, &display, &value)) != 0)
+			return status;
+		return standalone_run(command, display, value);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	for (int i = 0; i < HELPER_MAX_DISPLAYS; i++)
+		early_targets[i] = -1;
+
+	ddc_set_backend(&ddcutil_backend);
+	ddc_register_state_callback(state_changed);
+
+	while ((len = recv(SOCKET_FD, &msg, sizeof(Helper_Message), 0)) == sizeof(Helper_Message)) {
+
+		switch (msg.op) {
+
+		case HELPER_OP_INIT:
+			run_detached(init_thread, &msg);
+			break;
+
+		case HELPER_OP_GET_DISPLAY:
+			pthread_mutex_lock(&lock);
+			msg.display = is_discovered() ? ddc_get_display_id(msg.value) : DISPLAY_ID_NONE;
+			char *name = ddc_get_display_name(msg.display);
+			if (name != NULL) {
+				strncpy(msg.name, name, HELPER_NAME_SIZE - 1);
+				msg.name[HELPER_NAME_SIZE - 1] = '\0';
+				msg.value = ddc_get_bus_number(msg.display);
+			} else {
+				msg.display = DISPLAY_ID_NONE;
+				msg.name[0] = '\0';
+			}
+			pthread_mutex_unlock(&lock);
+			reply(&msg);
+			break;
+
+		case HELPER_OP_GET_BRIGHTNESS:
+			pthread_mutex_lock(&lock);
+			if (is_discovered()) {
+				run_detached(get_brightness_thread, &msg);
+			} else {
+				msg.value = -1;
+				reply(&msg);
+			}
+			pthread_mutex_unlock(&lock);
+			break;
+
+		case HELPER_OP_SET_BRIGHTNESS:
+			PROBE(ipc_receive, msg.trace_id, msg.display, msg.value);
+			pthread_mutex_lock(&lock);
+			if (is_discovered()) {
+				ddc_set_brightness_percentage(msg.display, msg.value, msg.trace_id);
+			} else if (DISPLAY_ID_SLOT(msg.display) < HELPER_MAX_DISPLAYS) {
+				early_displays[DISPLAY_ID_SLOT(msg.display)] = msg.display;
+				early_targets[DISPLAY_ID_SLOT(msg.display)] = msg.value;
+				early_trace_ids[DISPLAY_ID_SLOT(msg.display)] = msg.trace_id;
+			}
+			pthread_mutex_unlock(&lock);
+			break;
+
+		case HELPER_OP_SLEEP:
+			pthread_mutex_lock(&lock);
+			if (is_discovered())
+				run_detached(sleep_thread, &msg);
+			else
+				reply(&msg);
+			pthread_mutex_unlock(&lock);
+			break;
+
+		case HELPER_OP_PING:
+			/* a helper, that answers, can still have wedged workers */
+			msg.value = ddc_get_stalled_ms();
+			reply(&msg);
+			break;
+
+		case HELPER_OP_STATS:
+			msg.value = stat_of(msg.value);
+			reply(&msg);
+			break;
+
+		case HELPER_OP_QUIT:
+			/* workers may hang on a monitor, exiting is enough to release everything */
+			return 0;
+
+		default:
+			fprintf(stderr, "Unknown helper operation: %u\n", msg.op);
+			break;
+		}
+	}
+
+	/* recv returns 0, when the panel went away and the socket got closed */
+	if (len < 0)
+		perror("Error reading from applet");
+
+	return 0;
+}
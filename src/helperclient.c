@@ -0,0 +1,839 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "helperclient.h"
+#include "helperprotocol.h"
+#include "probes.h"
+
+#ifndef HELPER_PATH
+#define HELPER_PATH "budgie-monitor-brightness-helper"
+#endif
+
+/* number of requests, that can wait for an answer at the same time */
+#define MAX_PENDING 32
+
+/* while requests are pending, the helper gets pinged in this interval */
+#define PING_INTERVAL_MS 1000
+
+/* helper is restarted, if it does not answer a ping in this time */
+#define PING_TIMEOUT_MS 3000
+
+/* helper is restarted, if a request is pending, while one of its ddc operations hangs this long */
+#define STALL_TIMEOUT_MS 5000
+
+/* helper is restarted, if a request is not answered in this time */
+#define REQUEST_TIMEOUT_MS 30000
+
+/* time the helper gets to exit by itself before it is killed */
+#define QUIT_GRACE_MS 100
+
+/* how often discovery is tried, if the helper dies meanwhile */
+#define INIT_ATTEMPTS 2
+
+extern char **environ;
+
+/* a request waiting for its reply */
+typedef struct Pending_Call {
+	uint32_t seq;           /* 0 if this slot is free */
+	bool done;
+	bool failed;            /* helper died before answering */
+	long sent;              /* monotonic time in ms */
+	Helper_Message reply;
+	pthread_cond_t cond;
+} Pending_Call;
+
+/* guards everything below */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Pending_Call pending[MAX_PENDING];
+static bool pending_ready = false;
+static uint32_t next_seq = 1;
+
+static int sock = -1;
+static pid_t pid = -1;
+
+/* wakes up the reader thread */
+static int wakeup_pipe[2] = { -1, -1 };
+static pthread_t reader;
+static bool running = false;
+
+static long last_ping_sent = 0;
+static long last_pong = 0;
+/* how long the oldest ddc operation of the helper hung at the last pong */
+static long stalled_ms = 0;
+
+/* what the helper told about the displays, everything below is indexed by position in ids */
+static int displaycount = -1;
+static Display_Id ids[HELPER_MAX_DISPLAYS];
+static char names[HELPER_MAX_DISPLAYS][HELPER_NAME_SIZE];
+static int busnos[HELPER_MAX_DISPLAYS];
+
+/* latest wanted brightness per display, replayed after a restart */
+static int targets[HELPER_MAX_DISPLAYS];
+static unsigned int target_trace_ids[HELPER_MAX_DISPLAYS];
+/* targets, that could not be sent yet */
+static bool dirty[HELPER_MAX_DISPLAYS];
+
+/* displays, that do not answer in time */
+static bool degraded[HELPER_MAX_DISPLAYS];
+static void (*state_callback)(Display_Id, int) = NULL;
+
+/* the helper was restarted, its displays have to be asked for again */
+static bool stale = false;
+/* the next helper_count_displays_and_init starts a new helper, which searches the buses again */
+static bool rediscover = false;
+static void (*displays_callback)() = NULL;
+
+/**
+ * monotonic time in milliseconds
+ */
+static long now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * returns the position of a display in ids, -1 if the id is stale or unknown
+ */
+static int index_of(Display_Id id)
+{
+	for (int i = 0; i < displaycount; i++)
+		if (ids[i] == id)
+			return i;
+	return -1;
+}
+
+/**
+ * wakes up the reader thread, so it recalculates its timeouts
+ */
+static void wake_reader()
+{
+	char c = 0;
+	if (write(wakeup_pipe[1], &c, 1) < 0 && errno != EAGAIN)
+		perror("Error waking up helper reader");
+}
+
+/**
+ * sends without blocking, returns false if the message could not be sent
+ */
+static bool send_message(Helper_Message *msg)
+{
+	if (sock < 0)
+		return false;
+	return send(sock, msg, sizeof(Helper_Message), MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(Helper_Message);
+}
+
+/**
+ * sends all targets, that are not delivered yet, stops when the socket is full
+ */
+static void flush_targets()
+{
+	Helper_Message msg = { .op = HELPER_OP_SET_BRIGHTNESS };
+
+	for (int i = 0; i < HELPER_MAX_DISPLAYS; i++) {
+		if (!dirty[i])
+			continue;
+
+		msg.display = ids[i];
+		msg.value = targets[i];
+		msg.trace_id = target_trace_ids[i];
+		if (!send_message(&msg))
+			return;
+		dirty[i] = false;
+		PROBE(ipc_send, msg.trace_id, msg.display, msg.value);
+	}
+}
+
+/**
+ * true, if some targets wait for space in the socket
+ */
+static bool has_dirty_targets()
+{
+	for (int i = 0; i < HELPER_MAX_DISPLAYS; i++)
+		if (dirty[i])
+			return true;
+	return false;
+}
+
+/**
+ * returns the time the oldest pending request was sent, 0 if there is none
+ */
+static long oldest_pending()
+{
+	long oldest = 0;
+	for (int i = 0; i < MAX_PENDING; i++)
+		if (pending[i].seq != 0 && !pending[i].done && (oldest == 0 || pending[i].sent < oldest))
+			oldest = pending[i].sent;
+	return oldest;
+}
+
+/**
+ * lets all pending requests fail
+ */
+static void fail_pending()
+{
+	for (int i = 0; i < MAX_PENDING; i++) {
+		if (pending[i].seq != 0 && !pending[i].done) {
+			pending[i].done = true;
+			pending[i].failed = true;
+			pthread_cond_signal(&pending[i].cond);
+		}
+	}
+}
+
+/**
+ * spawns the helper process with one end of a socketpair as fd 0
+ */
+static int start_helper()
+{
+	int sv[2];
+	int status;
+	posix_spawn_file_actions_t actions;
+	char *path = getenv(HELPER_PATH_ENV) != NULL ? getenv(HELPER_PATH_ENV) : HELPER_PATH;
+	char *argv[] = { path, NULL };
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) {
+		perror("Error creating helper socket");
+		return -1;
+	}
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, sv[1], 0);
+	status = posix_spawn(&pid, path, &actions, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(sv[1]);
+
+	if (status != 0) {
+		fprintf(stderr, "Error starting %s: %s\n", path, strerror(status));
+		close(sv[0]);
+		pid = -1;
+		return -1;
+	}
+
+	sock = sv[0];
+	last_pong = now_ms();
+	stalled_ms = 0;
+	return 0;
+}
+
+/**
+ * waits for a stopped helper and kills it, if it does not quit in time
+ * has to be called without lock held, nobody else waits for the old helper
+ */
+static void reap_helper(pid_t old)
+{
+	if (old < 0)
+		return;
+
+	long deadline = now_ms() + QUIT_GRACE_MS;
+	while (waitpid(old, NULL, WNOHANG) == 0) {
+		if (now_ms() >= deadline) {
+			kill(old, SIGKILL);
+			waitpid(old, NULL, 0);
+			break;
+		}
+		usleep(5000);
+	}
+}
+
+static void reaper_thread(void *val)
+{
+	reap_helper((pid_t) (intptr_t) val);
+}
+
+/**
+ * asks the helper to quit and forgets it, returns its pid for reap_helper, -1 if none ran
+ * has to be called with lock held
+ */
+static pid_t stop_helper()
+{
+	Helper_Message msg = { .op = HELPER_OP_QUIT };
+	pid_t old = pid;
+
+	if (pid < 0)
+		return -1;
+
+	send_message(&msg);
+	close(sock);
+	sock = -1;
+	pid = -1;
+	return old;
+}
+
+/**
+ * stops the helper and reaps it in another thread, so callers holding lock do not wait for it
+ */
+static void stop_helper_later()
+{
+	pthread_t id;
+	int status;
+	pid_t old = stop_helper();
+
+	if (old < 0)
+		return;
+
+	if ((status = pthread_create(&id, NULL, (void*) reaper_thread, (void*) (intptr_t) old)) != 0) {
+		fprintf(stderr, "Error creating thread: %d\n", status);
+		kill(old, SIGKILL);
+		waitpid(old, NULL, 0);
+		return;
+	}
+	pthread_detach(id);
+}
+
+/**
+ * stores degraded state of a display and tells the callback about changes
+ */
+static void set_degraded(int index, bool state)
+{
+	if (index < 0 || index >= HELPER_MAX_DISPLAYS || degraded[index] == state)
+		return;
+
+	degraded[index] = state;
+	if (state_callback != NULL)
+		state_callback(ids[index], state);
+}
+
+/**
+ * replaces the helper, the new one rediscovers and gets the latest targets
+ */
+static void respawn_helper()
+{
+	Helper_Message msg = { .op = HELPER_OP_INIT };
+
+	stop_helper_later();
+	fail_pending();
+
+	/* a new helper starts with healthy displays */
+	for (int i = 0; i < HELPER_MAX_DISPLAYS; i++)
+		set_degraded(i, false);
+
+	if (start_helper() != 0)
+		return;
+
+	/*
+	 * replies to seq 0 are ignored, the helper buffers targets until discovery is done
+	 * ids are made from slot and edid, the new helper ignores targets of displays,
+	 * that are gone or moved to another slot
+	 */
+	if (displaycount > 0) {
+		send_message(&msg);
+		for (int i = 0; i < displaycount; i++)
+			dirty[i] = targets[i] != -1;
+		flush_targets();
+	}
+}
+
+/**
+ * replaces a dead or wedged helper and tells about it
+ */
+static void restart_helper()
+{
+	fprintf(stderr, "Restarting brightness helper\n");
+	respawn_helper();
+
+	/* monitors may have changed, while the old helper hung */
+	stale = true;
+	if (displays_callback != NULL)
+		displays_callback();
+}
+
+/**
+ * hands a reply to the request waiting for it
+ */
+static void dispatch_reply(Helper_Message *msg)
+{
+	if (msg -> op == HELPER_OP_PING) {
+		last_pong = now_ms();
+		stalled_ms = msg -> value;
+		return;
+	}
+
+	if (msg -> op == HELPER_OP_STATE) {
+		set_degraded(index_of(msg -> display), msg -> value != 0);
+		return;
+	}
+
+	for (int i = 0; i < MAX_PENDING; i++) {
+		if (pending[i].seq == msg -> seq && msg -> seq != 0) {
+			pending[i].reply = *msg;
+			pending[i].done = true;
+			pthread_cond_signal(&pending[i].cond);
+			return;
+		}
+	}
+}
+
+/**
+ * receives replies, flushes targets and restarts the helper if it wedges
+ * only wakes up periodically while requests are pending
+ */
+static void reader_thread(void *val)
+{
+	struct pollfd fds[2];
+	Helper_Message msg;
+	char buf[16];
+
+	pthread_mutex_lock(&lock);
+	while (running) {
+
+		long oldest = oldest_pending();
+		int timeout = oldest != 0 ? PING_INTERVAL_MS : -1;
+
+		fds[0].fd = sock;
+		fds[0].events = POLLIN | (has_dirty_targets() ? POLLOUT : 0);
+		fds[1].fd = wakeup_pipe[0];
+		fds[1].events = POLLIN;
+
+		pthread_mutex_unlock(&lock);
+		int ret = poll(fds, 2, timeout);
+		pthread_mutex_lock(&lock);
+
+		if (!running)
+			break;
+
+		if (ret < 0 && errno != EINTR) {
+			perror("Error polling helper socket");
+			break;
+		}
+
+		if (ret > 0 && (fds[1].revents & POLLIN)) {
+			while (read(wakeup_pipe[0], buf, sizeof(buf)) > 0);
+		}
+
+		/* socket changed meanwhile */
+		if (fds[0].fd != sock)
+			continue;
+
+		if (ret > 0 && (fds[0].revents & POLLIN)) {
+			ssize_t len = recv(sock, &msg, sizeof(Helper_Message), MSG_DONTWAIT);
+			if (len == sizeof(Helper_Message)) {
+				dispatch_reply(&msg);
+			} else if (len == 0 || (len < 0 && errno != EAGAIN)) {
+				restart_helper();
+				continue;
+			}
+		} else if (ret > 0 && (fds[0].revents & (POLLHUP | POLLERR))) {
+			restart_helper();
+			continue;
+		}
+
+		if (ret > 0 && (fds[0].revents & POLLOUT))
+			flush_targets();
+
+		/* watchdog */
+		oldest = oldest_pending();
+		if (oldest != 0) {
+			long now = now_ms();
+			if (now - last_pong > PING_TIMEOUT_MS || stalled_ms > STALL_TIMEOUT_MS || now - oldest > REQUEST_TIMEOUT_MS) {
+				restart_helper();
+			} else if (now - last_ping_sent >= PING_INTERVAL_MS) {
+				Helper_Message ping = { .op = HELPER_OP_PING };
+				send_message(&ping);
+				last_ping_sent = now;
+			}
+		}
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * starts helper and reader thread, if they do not run yet
+ * has to be called with lock held
+ */
+static int ensure_started()
+{
+	int status;
+
+	if (running)
+		return 0;
+
+	if (pipe2(wakeup_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+		perror("Error creating pipe");
+		return -1;
+	}
+
+	if (!pending_ready) {
+		for (int i = 0; i < MAX_PENDING; i++)
+			pthread_cond_init(&pending[i].cond, NULL);
+		pending_ready = true;
+	}
+	for (int i = 0; i < HELPER_MAX_DISPLAYS; i++) {
+		targets[i] = -1;
+		dirty[i] = false;
+		degraded[i] = false;
+	}
+
+	if (start_helper() != 0)
+		return -1;
+
+	running = true;
+	if ((status = pthread_create(&reader, NULL, (void*) reader_thread, NULL)) != 0) {
+		fprintf(stderr, "Error creating thread: %d\n", status);
+		running = false;
+		stop_helper_later();
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * sends msg and waits for its reply, which is stored in msg
+ * returns 0 on success, has to be called with lock held
+ */
+static int call(Helper_Message *msg)
+{
+	Pending_Call *slot = NULL;
+
+	for (int i = 0; i < MAX_PENDING && slot == NULL; i++)
+		if (pending[i].seq == 0)
+			slot = &pending[i];
+
+	if (slot == NULL) {
+		fprintf(stderr, "Too many pending helper requests\n");
+		return -1;
+	}
+
+	/* a dead helper could not be restarted before, try again */
+	if (sock < 0)
+		restart_helper();
+
+	/* do not count the idle time before this request as missing pong */
+	if (oldest_pending() == 0)
+		last_pong = now_ms();
+
+	msg -> seq = next_seq++;
+	if (next_seq == 0)
+		next_seq = 1;
+
+	slot -> seq = msg -> seq;
+	slot -> done = false;
+	slot -> failed = false;
+	slot -> sent = now_ms();
+
+	if (!send_message(msg)) {
+		slot -> seq = 0;
+		return -1;
+	}
+
+	/* reader has to start pinging */
+	wake_reader();
+
+	while (!slot -> done)
+		pthread_cond_wait(&slot -> cond, &lock);
+
+	*msg = slot -> reply;
+	slot -> seq = 0;
+
+	return slot -> failed ? -1 : 0;
+}
+
+/**
+ * starts the helper process, lets it discover displays and gives back their number
+ */
+int helper_count_displays_and_init()
+{
+	Helper_Message msg;
+	int count = 0;
+
+	pthread_mutex_lock(&lock);
+
+	if (displaycount != -1 && !stale && !rediscover) {
+		pthread_mutex_unlock(&lock);
+		return displaycount;
+	}
+
+	/* a running helper knows only the monitors of its start */
+	if (rediscover && running)
+		respawn_helper();
+	rediscover = false;
+
+	if (ensure_started() != 0) {
+		pthread_mutex_unlock(&lock);
+		return 0;
+	}
+
+	for (int attempt = 0; attempt < INIT_ATTEMPTS; attempt++) {
+		msg = (Helper_Message) { .op = HELPER_OP_INIT };
+		if (call(&msg) == 0) {
+			count = msg.value;
+			break;
+		}
+	}
+
+	if (count > HELPER_MAX_DISPLAYS)
+		count = HELPER_MAX_DISPLAYS;
+
+	/* displays, that are gone meanwhile, are left out */
+	Display_Id found[HELPER_MAX_DISPLAYS];
+	char foundnames[HELPER_MAX_DISPLAYS][HELPER_NAME_SIZE];
+	int foundbusnos[HELPER_MAX_DISPLAYS];
+	int n = 0;
+	for (int i = 0; i < count; i++) {
+		msg = (Helper_Message) { .op = HELPER_OP_GET_DISPLAY, .value = i };
+		if (call(&msg) != 0 || msg.display == DISPLAY_ID_NONE)
+			continue;
+		found[n] = msg.display;
+		memcpy(foundnames[n], msg.name, HELPER_NAME_SIZE);
+		foundnames[n][HELPER_NAME_SIZE - 1] = '\0';
+		foundbusnos[n] = msg.value;
+		n++;
+	}
+
+	/* targets and states follow their display to its new position, not the position */
+	int newtargets[HELPER_MAX_DISPLAYS];
+	unsigned int newtrace_ids[HELPER_MAX_DISPLAYS];
+	bool newdirty[HELPER_MAX_DISPLAYS];
+	bool newdegraded[HELPER_MAX_DISPLAYS];
+	for (int i = 0; i < n; i++) {
+		int old = index_of(found[i]);
+		newtargets[i] = old >= 0 ? targets[old] : -1;
+		newtrace_ids[i] = old >= 0 ? target_trace_ids[old] : 0;
+		newdirty[i] = old >= 0 && dirty[old];
+		newdegraded[i] = old >= 0 && degraded[old];
+	}
+	for (int i = 0; i < HELPER_MAX_DISPLAYS; i++) {
+		ids[i] = i < n ? found[i] : DISPLAY_ID_NONE;
+		if (i < n) {
+			memcpy(names[i], foundnames[i], HELPER_NAME_SIZE);
+			busnos[i] = foundbusnos[i];
+		}
+		targets[i] = i < n ? newtargets[i] : -1;
+		target_trace_ids[i] = i < n ? newtrace_ids[i] : 0;
+		dirty[i] = i < n && newdirty[i];
+		degraded[i] = i < n && newdegraded[i];
+	}
+
+	/* a restart while asking was answered by the new helper already */
+	stale = false;
+	displaycount = n;
+
+	pthread_mutex_unlock(&lock);
+	return n;
+}
+
+/**
+ * lets the next helper_count_displays_and_init search the buses again, like after hotplug
+ */
+void helper_request_rediscovery()
+{
+	pthread_mutex_lock(&lock);
+	rediscover = true;
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * returns the id of the n-th display
+ */
+Display_Id helper_get_display_id(int n)
+{
+	pthread_mutex_lock(&lock);
+	Display_Id id = n >= 0 && n < displaycount ? ids[n] : DISPLAY_ID_NONE;
+	pthread_mutex_unlock(&lock);
+	return id;
+}
+
+/**
+ * copies the monitorname of selected display, returns -1 if the id is stale
+ */
+int helper_get_display_name(Display_Id id, char *name, size_t size)
+{
+	pthread_mutex_lock(&lock);
+	int index = index_of(id);
+	if (index >= 0)
+		snprintf(name, size, "%s", names[index]);
+	pthread_mutex_unlock(&lock);
+	return index >= 0 ? 0 : -1;
+}
+
+/**
+ * returns the i2c bus of selected display, negative if it is not on an i2c bus or the id is stale
+ */
+int helper_get_bus_number(Display_Id id)
+{
+	pthread_mutex_lock(&lock);
+	int index = index_of(id);
+	int busno = index >= 0 ? busnos[index] : -1;
+	pthread_mutex_unlock(&lock);
+	return busno;
+}
+
+/**
+ * asks the helper for the brightness of selected display, -1 on failure
+ */
+static int get_brightness(Display_Id id, int prefetch)
+{
+	Helper_Message msg = { .op = HELPER_OP_GET_BRIGHTNESS, .display = id, .value = prefetch };
+	int value = -1;
+
+	pthread_mutex_lock(&lock);
+	if (running && index_of(id) >= 0 && call(&msg) == 0)
+		value = msg.value;
+	pthread_mutex_unlock(&lock);
+
+	return value;
+}
+
+/**
+ * returns brightness of selected display, -1 on failure
+ */
+int helper_get_brightness_percentage(Display_Id id)
+{
+	return get_brightness(id, 0);
+}
+
+/**
+ * returns brightness of selected display, -1 on failure or if a user request needed the bus
+ */
+int helper_prefetch_brightness_percentage(Display_Id id)
+{
+	return get_brightness(id, 1);
+}
+
+/**
+ * returns a counter of the helper, -1 if it is not running
+ */
+long helper_get_stat(Helper_Stat stat)
+{
+	Helper_Message msg = { .op = HELPER_OP_STATS, .value = stat };
+	long value = -1;
+
+	pthread_mutex_lock(&lock);
+	if (running && call(&msg) == 0)
+		value = msg.value;
+	pthread_mutex_unlock(&lock);
+
+	return value;
+}
+
+/**
+ * returns 1, if the selected display does not answer in time
+ */
+int helper_is_degraded(Display_Id id)
+{
+	pthread_mutex_lock(&lock);
+	int index = index_of(id);
+	int state = index >= 0 && degraded[index];
+	pthread_mutex_unlock(&lock);
+	return state;
+}
+
+/**
+ * sets function, that gets called, when the displays may have changed
+ */
+void helper_register_displays_callback(void (*callback)())
+{
+	pthread_mutex_lock(&lock);
+	displays_callback = callback;
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * sets function, that gets called with display id and degraded state, when it changes
+ */
+void helper_register_state_callback(void (*callback)(Display_Id, int))
+{
+	pthread_mutex_lock(&lock);
+	state_callback = callback;
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * sets brightness of selected display, never blocks
+ */
+void helper_set_brightness_percentage(Display_Id id, int value, unsigned int trace_id)
+{
+	pthread_mutex_lock(&lock);
+	int index = index_of(id);
+	if (running && index >= 0) {
+		targets[index] = value;
+		target_trace_ids[index] = trace_id;
+		dirty[index] = true;
+		flush_targets();
+
+		/* socket is full, reader sends it later */
+		if (has_dirty_targets())
+			wake_reader();
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * tells the helper, that the system goes to sleep (1) or resumed (0)
+ * before sleep it returns, when the helper left the monitors alone
+ */
+void helper_set_sleeping(int sleeping)
+{
+	Helper_Message msg = { .op = HELPER_OP_SLEEP, .value = sleeping };
+
+	pthread_mutex_lock(&lock);
+	if (running && displaycount > 0)
+		call(&msg);
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * stops the helper process
+ */
+void helper_free()
+{
+	pthread_mutex_lock(&lock);
+	if (!running) {
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+	running = false;
+	wake_reader();
+	pthread_mutex_unlock(&lock);
+
+	/* the reader never waits for the helper, so this returns quickly */
+	pthread_join(reader, NULL);
+
+	pthread_mutex_lock(&lock);
+	pid_t old = stop_helper();
+	fail_pending();
+	displaycount = -1;
+	close(wakeup_pipe[0]);
+	close(wakeup_pipe[1]);
+	pthread_mutex_unlock(&lock);
+
+	reap_helper(old);
+}
@@ -0,0 +1,107 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "displayid.h"
+#include "helperprotocol.h"
+
+/**
+ * starts the helper process, lets it discover displays and gives back their number
+ * blocks until discovery is finished, so do not call it from the main thread
+ */
+int helper_count_displays_and_init();
+
+/**
+ * lets the next helper_count_displays_and_init search the buses again, like after hotplug
+ * targets of monitors, that are still there, are kept
+ */
+void helper_request_rediscovery();
+
+/**
+ * returns the id of the n-th display
+ */
+Display_Id helper_get_display_id(int n);
+
+/**
+ * copies the monitorname of selected display into name, a restart or rediscovery may replace it
+ * any time after the lock is given back, returns -1 if the id is stale
+ */
+int helper_get_display_name(Display_Id id, char *name, size_t size);
+
+/**
+ * returns the i2c bus of selected display, negative if it is not on an i2c bus or the id is stale
+ */
+int helper_get_bus_number(Display_Id id);
+
+/**
+ * returns brightness of selected display, -1 on failure
+ * blocks until the helper answers, so do not call it from the main thread
+ */
+int helper_get_brightness_percentage(Display_Id id);
+
+/**
+ * returns brightness of selected display, -1 on failure or if a user request needed the bus
+ * blocks until the helper answers, so do not call it from the main thread
+ */
+int helper_prefetch_brightness_percentage(Display_Id id);
+
+/**
+ * returns a counter of the helper, -1 if it is not running
+ * blocks until the helper answers, so do not call it from the main thread
+ */
+long helper_get_stat(Helper_Stat stat);
+
+/**
+ * returns 1, if the selected display does not answer in time
+ */
+int helper_is_degraded(Display_Id id);
+
+/**
+ * sets function, that gets called, when the displays may have changed, like after a restart
+ * of a wedged helper, helper_count_displays_and_init asks for them again then
+ * it is called from another thread and must not call functions of helperclient
+ */
+void helper_register_displays_callback(void (*callback)());
+
+/**
+ * sets function, that gets called with display id and degraded state, when it changes
+ * it is called from another thread
+ */
+void helper_register_state_callback(void (*callback)(Display_Id, int));
+
+/**
+ * sets brightness of selected display, never blocks
+ * trace_id correlates tracepoints of this change, stale ids are ignored
+ */
+void helper_set_brightness_percentage(Display_Id id, int value, unsigned int trace_id);
+
+/**
+ * tells the helper, that the system goes to sleep (1) or resumed (0)
+ * blocks until the helper answers, so do not call it from the main thread
+ */
+void helper_set_sleeping(int sleeping);
+
+/**
+ * stops the helper process
+ */
+void helper_free();
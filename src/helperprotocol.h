@@ -0,0 +1,67 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "displayid.h"
+
+/* environment variable, that starts another helper than the installed one, like the one of a build directory */
+#define HELPER_PATH_ENV "BUDGIE_BRIGHTNESS_HELPER"
+
+/* maximum length of a display name sent over the socket (including \0) */
+#define HELPER_NAME_SIZE 64
+
+/* maximum number of ddc displays the helper reports */
+#define HELPER_MAX_DISPLAYS MAX_DDC_DISPLAYS
+
+/* operations understood by the helper process */
+typedef enum Helper_Op {
+	HELPER_OP_INIT = 1,             /* discovery, reply value is displaycount */
+	HELPER_OP_GET_DISPLAY,          /* request value is n, reply display, name and value are id, monitorname and i2c bus of the n-th display */
+	HELPER_OP_GET_BRIGHTNESS,       /* request value is 1 for a prefetch, reply value is the brightness of display, -1 if the id is stale */
+	HELPER_OP_SET_BRIGHTNESS,       /* no reply */
+	HELPER_OP_PING,                 /* reply value is how long the oldest ddc operation hangs in ms, answered by the main loop only */
+	HELPER_OP_QUIT,                 /* no reply */
+	HELPER_OP_STATE,                /* sent by the helper, value is 1 if display is degraded */
+	HELPER_OP_SLEEP,                /* value is 1 before the system sleeps and 0 after it resumed, reply when the workers follow */
+	HELPER_OP_STATS                 /* request value is a Helper_Stat, reply value is the counter, answered by the main loop */
+} Helper_Op;
+
+/* counters of the helper, that can be asked for with HELPER_OP_STATS */
+typedef enum Helper_Stat {
+	HELPER_STAT_WAKEUPS = 0,        /* wakeups of ddcwrapper threads, stands still while idle */
+	HELPER_STAT_BUS_CONTENTIONS,    /* transactions, that waited for the flock of another process */
+	HELPER_STAT_BUS_LOCK_TIMEOUTS   /* transactions, that went on without the flock */
+} Helper_Stat;
+
+/**
+ * one message on the SOCK_SEQPACKET socket between applet and helper,
+ * requests and replies use the same layout, replies carry the seq of their request
+ */
+typedef struct Helper_Message {
+	uint32_t op;
+	uint32_t seq;
+	uint32_t display;       /* Display_Id, see displayid.h */
+	int32_t value;
+	uint32_t trace_id;      /* correlation id for tracepoints, see probes.h */
+	char name[HELPER_NAME_SIZE];
+} Helper_Message;
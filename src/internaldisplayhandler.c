@@ -22,11 +22,14 @@
 #include <pthread.h>
 #include <stdlib.h>
 
+#include "displayid.h"
 #include "internaldisplayhandler.h"
+#include "probes.h"
 
 #define PROPERTYNAME "Brightness"
 
 static int wished_brightness = -1;
+static unsigned int wished_trace_id = 0;
 static int do_emit_signal = 1;
 /* if this thread is false, all threads end, as soon as they wake up */
 static char cont = 1;
@@ -91,8 +94,10 @@ static void set_brightness_thread(void *val)
         }
         
         last_brightness = wished_brightness;
+        unsigned int trace_id = wished_trace_id;
         /* sets birghtness */
         if (proxy != NULL) {
+            PROBE(dbus_set_start, trace_id, DISPLAY_ID_INTERNAL, last_brightness);
             g_dbus_proxy_call_sync(proxy,
                               "org.freedesktop.DBus.Properties.Set",
                               g_variant_new("(ssv)",
@@ -103,9 +108,11 @@ static void set_brightness_thread(void *val)
                               -1,
                               NULL,
                               &error);
+            PROBE(dbus_set_done, trace_id, DISPLAY_ID_INTERNAL, error == NULL);
             if (error != NULL) {
                 g_print("Proxy call error: %s\n", error -> message);
                 g_error_free(error);
+                error = NULL;
             }
             
             do_emit_signal = 1;
@@ -201,13 +208,14 @@ int internal_get_brightness()
 /**
  * sets internal brightness
  */
-void internal_set_brightness(int percentage) 
+void internal_set_brightness(int percentage, unsigned int trace_id) 
 {
     if (percentage < 100) {
         percentage++;
     }
     /* it seems, as if proxy tells brightness one to low */
     if (proxy != NULL && percentage != wished_brightness) {
+        wished_trace_id = trace_id;
         wished_brightness = percentage;
         do_emit_signal = 0;
         pthread_cond_signal(&cond);
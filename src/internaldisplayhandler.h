@@ -29,9 +29,9 @@ void internal_init(void (*callback)(int));
 int internal_get_brightness();
 
 /**
- * sets internal brightness
+ * sets internal brightness, trace_id correlates tracepoints of this change
  */
-void internal_set_brightness(int percentage);
+void internal_set_brightness(int percentage, unsigned int trace_id);
 
 /**
  * sets function to call, if brightness changes
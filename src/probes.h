@@ -0,0 +1,62 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+/*
+ * Static tracepoints along the way of a brightness change, from the slider
+ * to the monitor. Every probe gets the correlation id of the change, the
+ * display id (see displayid.h) and the brightness value:
+ *
+ *   applet.c                  slider_changed, scroll_changed, key_changed
+ *   displaymanager.c          dispatch
+ *   helperclient.c            ipc_send
+ *   helper.c                  ipc_receive
+ *   ddcwrapper.c              worker_wakeup, open_done, write_start, write_done, verify_done
+ *   internaldisplayhandler.c  dbus_set_start, dbus_set_done
+ *
+ * They are USDT probes of the provider budgie_brightness, so they can be
+ * used with systemtap, bpftrace or perf. Build with -Dtracepoints=true,
+ * without it every probe and id compiles to nothing.
+ */
+
+#ifdef HAVE_SDT
+
+#include <sys/sdt.h>
+
+#define PROBE(name, id, dispnum, value) DTRACE_PROBE3(budgie_brightness, name, id, dispnum, value)
+
+/**
+ * returns a new correlation id for a brightness change
+ */
+static inline unsigned int probe_new_id(void)
+{
+	static unsigned int next_id = 0;
+	return __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+}
+
+#else
+
+/* arguments are not evaluated, sizeof only keeps them used */
+#define PROBE(name, id, dispnum, value) do { (void) sizeof(id); (void) sizeof(dispnum); (void) sizeof(value); } while (0)
+
+#define probe_new_id() 0u
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "sleepwatcher.h"
+
+#define LOGIND_NAME "org.freedesktop.login1"
+#define LOGIND_PATH "/org/freedesktop/login1"
+#define LOGIND_MANAGER "org.freedesktop.login1.Manager"
+
+static GDBusConnection *system_bus = NULL;
+static guint subscription = 0;
+static void (*callback)(int) = NULL;
+static gboolean watching = FALSE;
+
+/* delay lock of logind, it sleeps as soon as this is closed */
+static int inhibitor = -1;
+
+/**
+ * closes the delay lock, so logind can go on sleeping
+ */
+static void release_inhibitor()
+{
+    int fd = __atomic_exchange_n(&inhibitor, -1, __ATOMIC_SEQ_CST);
+    if (fd >= 0)
+        close(fd);
+}
+
+/**
+ * stores the delay lock, that logind handed out
+ */
+static void inhibitor_taken(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+    GError *error = NULL;
+    GUnixFDList *fds = NULL;
+    GVariant *result;
+    gint32 index;
+    
+    result = g_dbus_connection_call_with_unix_fd_list_finish(G_DBUS_CONNECTION(source_object), &fds, res, &error);
+    if (result == NULL) {
+        g_printerr("Error taking sleep delay lock: %s\n", error -> message);
+        g_error_free(error);
+        return;
+    }
+    
+    g_variant_get(result, "(h)", &index);
+    int fd = g_unix_fd_list_get(fds, index, &error);
+    if (fd < 0) {
+        g_printerr("Error taking sleep delay lock: %s\n", error -> message);
+        g_error_free(error);
+    } else {
+        /* an older lock is not needed anymore */
+        fd = __atomic_exchange_n(&inhibitor, fd, __ATOMIC_SEQ_CST);
+        if (fd >= 0)
+            close(fd);
+    }
+    
+    g_variant_unref(result);
+    g_object_unref(fds);
+}
+
+/**
+ * asks logind to wait for the monitors to be left alone, before it sleeps
+ */
+static void take_inhibitor()
+{
+    g_dbus_connection_call_with_unix_fd_list(system_bus,
+                                             LOGIND_NAME,
+                                             LOGIND_PATH,
+                                             LOGIND_MANAGER,
+                                             "Inhibit",
+                                             g_variant_new("(ssss)", "sleep", "Budgie Monitor Brightness",
+                                                           "Closing connections to monitors", "delay"),
+                                             G_VARIANT_TYPE("(h)"),
+                                             G_DBUS_CALL_FLAGS_NONE,
+                                             -1,
+                                             NULL,
+                                             NULL,
+                                             inhibitor_taken,
+                                             NULL);
+}
+
+/**
+ * tells the callback about sleep and lets logind go on afterwards
+ */
+static void sleep_thread(void *val)
+{
+    int sleeping = GPOINTER_TO_INT(val);
+    
+    callback(sleeping);
+    if (sleeping)
+        release_inhibitor();
+}
+
+/**
+ * signal of logind, the callback may block, so it runs in its own thread
+ */
+static void prepare_for_sleep(GDBusConnection *connection,
+                              const gchar *sender_name,
+                              const gchar *object_path,
+                              const gchar *interface_name,
+                              const gchar *signal_name,
+                              GVariant *parameters,
+                              gpointer user_data)
+{
+    gboolean sleeping;
+    pthread_t id;
+    int status;
+    
+    g_variant_get(parameters, "(b)", &sleeping);
+    
+    /* the next sleep needs a new delay lock */
+    if (!sleeping)
+        take_inhibitor();
+    
+    status = pthread_create(&id, NULL, (void*) sleep_thread, GINT_TO_POINTER(sleeping ? 1 : 0));
+    if (status != 0) {
+        fprintf(stderr, "Error creating thread: %d\n", status);
+        if (sleeping)
+            release_inhibitor();
+        return;
+    }
+    pthread_detach(id);
+}
+
+/**
+ * subscribes to PrepareForSleep, as soon as the system bus is there
+ */
+static void bus_connected(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+    GError *error = NULL;
+    
+    GDBusConnection *connection = g_bus_get_finish(res, &error);
+    if (connection == NULL) {
+        g_printerr("Error connecting to system bus: %s\n", error -> message);
+        g_error_free(error);
+        return;
+    }
+    
+    /* destroyed, while connecting */
+    if (!watching) {
+        g_object_unref(connection);
+        return;
+    }
+    system_bus = connection;
+    
+    subscription = g_dbus_connection_signal_subscribe(system_bus,
+                                                      LOGIND_NAME,
+                                                      LOGIND_MANAGER,
+                                                      "PrepareForSleep",
+                                                      LOGIND_PATH,
+                                                      NULL,
+                                                      G_DBUS_SIGNAL_FLAGS_NONE,
+                                                      prepare_for_sleep,
+                                                      NULL,
+                                                      NULL);
+    take_inhibitor();
+}
+
+/**
+ * listens for PrepareForSleep of logind and tells callback about it
+ * does nothing, if it already listens
+ */
+void sleep_watch_init(void (*sleep_callback)(int))
+{
+    if (watching)
+        return;
+    watching = TRUE;
+    
+    callback = sleep_callback;
+    g_bus_get(G_BUS_TYPE_SYSTEM, NULL, bus_connected, NULL);
+}
+
+/**
+ * stops listening and lets logind sleep without waiting
+ */
+void sleep_watch_destroy()
+{
+    watching = FALSE;
+    if (system_bus != NULL) {
+        g_dbus_connection_signal_unsubscribe(system_bus, subscription);
+        g_object_unref(system_bus);
+        system_bus = NULL;
+    }
+    release_inhibitor();
+}
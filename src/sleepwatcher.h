@@ -0,0 +1,34 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+/**
+ * listens for PrepareForSleep of logind, callback gets 1 before the system
+ * sleeps and 0 after it resumed. It is called in its own thread and may block,
+ * logind waits for it before sleeping, as long as its delay allows.
+ * Calling it again does nothing until sleep_watch_destroy.
+ */
+void sleep_watch_init(void (*callback)(int));
+
+/**
+ * stops listening and lets logind sleep without waiting
+ */
+void sleep_watch_destroy();
@@ -0,0 +1,65 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * A fast drag emits far more value-changed signals than monitors can take.
+ * Only the latest value is kept and sent once per frame of the frame clock,
+ * the value on release goes out at once. The applet drives this from its
+ * signal handlers, tests drive it with synthetic events.
+ */
+
+#include "slidervalue.h"
+
+void slider_value_init(Slider_Value *value)
+{
+	value -> pending = -1;
+	value -> trace_id = 0;
+	value -> frame_requested = false;
+}
+
+bool slider_value_change(Slider_Value *value, int wanted, unsigned int trace_id)
+{
+	value -> pending = wanted;
+	value -> trace_id = trace_id;
+	
+	if (value -> frame_requested)
+		return false;
+	value -> frame_requested = true;
+	return true;
+}
+
+bool slider_value_flush(Slider_Value *value, Display_Id id, bool held, Slider_Send send)
+{
+	/* a frame, that comes after this flush, has nothing to do */
+	value -> frame_requested = false;
+	
+	if (value -> pending == -1 || held)
+		return false;
+	
+	int wanted = value -> pending;
+	value -> pending = -1;
+	send(id, wanted, value -> trace_id);
+	return true;
+}
+
+bool slider_value_pending(const Slider_Value *value)
+{
+	return value -> pending != -1;
+}
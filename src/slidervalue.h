@@ -0,0 +1,58 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "displayid.h"
+
+/* the value of a slider on its way to the backend, a fast drag sends only the latest one per frame */
+typedef struct Slider_Value {
+	int pending;                    /* value not sent yet, -1 if none */
+	unsigned int trace_id;          /* correlates the tracepoints of the pending value */
+	bool frame_requested;           /* the next frame sends the pending value */
+} Slider_Value;
+
+/* sends a value to the backend, like set_brightness_percentage */
+typedef void (*Slider_Send)(Display_Id id, int value, unsigned int trace_id);
+
+/**
+ * nothing is pending
+ */
+void slider_value_init(Slider_Value *value);
+
+/**
+ * keeps the latest value of the slider until the next flush
+ * returns true, if the caller has to request a frame, that flushes it
+ */
+bool slider_value_change(Slider_Value *value, int wanted, unsigned int trace_id);
+
+/**
+ * sends the pending value at a frame, on release or whenever it has to go out at once
+ * it stays pending while held, for a display the backend does not know yet
+ * returns true, if it was sent
+ */
+bool slider_value_flush(Slider_Value *value, Display_Id id, bool held, Slider_Send send);
+
+/**
+ * tells, if a value was not sent yet
+ */
+bool slider_value_pending(const Slider_Value *value);
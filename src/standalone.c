@@ -0,0 +1,124 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <ddcutil_c_api.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ddcbackend.h"
+#include "ddcutilbackend.h"
+#include "displayid.h"
+#include "standalone.h"
+#include "topology.h"
+
+/**
+ * opens the display on an i2c bus without discovery
+ */
+static DDCA_Status open_bus(int busno, DDCA_Display_Handle *handle)
+{
+	DDCA_Display_Identifier did;
+	DDCA_Display_Ref ref;
+	DDCA_Status rc;
+
+	if ((rc = ddca_create_busno_display_identifier(busno, &did)) != 0)
+		return rc;
+	rc = ddca_create_display_ref(did, &ref);
+	ddca_free_display_identifier(did);
+	if (rc != 0)
+		return rc;
+
+	return ddca_open_display2(ref, true, handle);
+}
+
+/**
+ * finds the displays with ddcutil, if there is no topology file yet
+ */
+static int discover(Topology_Entry *entries, int max)
+{
+	DDCA_Display_Info_List *list;
+	int count = 0;
+
+	if (ddca_get_display_info_list2(false, &list) != 0)
+		return 0;
+
+	for (int i = 0; i < list -> ct && count < max; i++) {
+		DDCA_Display_Info *info = &list -> info[i];
+		if (info -> path.io_mode != DDCA_IO_I2C)
+			continue;
+		entries[count].busno = info -> path.path.i2c_busno;
+		strncpy(entries[count].name, info -> model_name, TOPOLOGY_NAME_SIZE - 1);
+		entries[count].name[TOPOLOGY_NAME_SIZE - 1] = '\0';
+		count++;
+	}
+
+	ddca_free_display_info_list(list);
+	return count;
+}
+
+/**
+ * runs a command of the command line client on the monitors directly, returns the exit code
+ */
+int standalone_run(Command command, int display, int value)
+{
+	Topology_Entry entries[MAX_DDC_DISPLAYS];
+	int status = 0;
+
+	int count = topology_read(entries, MAX_DDC_DISPLAYS);
+	if (count < 0)
+		count = discover(entries, MAX_DDC_DISPLAYS);
+
+	if (display >= count) {
+		fprintf(stderr, "No display %d\n", display);
+		return 1;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (display != -1 && display != i)
+			continue;
+
+		DDCA_Display_Handle handle;
+		DDCA_Status rc = open_bus(entries[i].busno, &handle);
+		if (rc != 0) {
+			fprintf(stderr, "Error opening %s: %s\n", entries[i].name, ddca_rc_desc(rc));
+			status = 1;
+			continue;
+		}
+
+		/* percentages are scaled to the maximum of the monitor like ddcwrapper does, one read tells it */
+		Ddc_Value val;
+		rc = ddcutil_backend.get(handle, BRIGHTNESS_VCP_CODE, &val);
+		if (command == COMMAND_SET) {
+			if (rc == 0)
+				rc = ddcutil_backend.set(handle, BRIGHTNESS_VCP_CODE, ddc_to_raw(value, val.max));
+			if (rc != 0) {
+				fprintf(stderr, "Error setting brightness of %s: %s\n", entries[i].name, ddca_rc_desc(rc));
+				status = 1;
+			}
+		} else {
+			print_display(command, i, entries[i].name, rc == 0 ? ddc_to_percentage(val.current, val.max) : -1);
+			if (rc != 0)
+				status = 1;
+		}
+
+		ddca_close_display(handle);
+	}
+
+	return status;
+}
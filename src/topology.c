@@ -0,0 +1,223 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * The helper stores the displays it found, so the command line client can
+ * reach them without discovery, when the applet does not run. The file has
+ * one line per display: the i2c bus number, a tab and the monitor name.
+ *
+ * The applet stores its sliders next to it, so it can show them before
+ * discovery finishes. Every line holds id, minimum, brightness and name,
+ * separated by tabs.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "topology.h"
+
+#define TOPOLOGY_DIR "budgie-monitor-brightness"
+#define TOPOLOGY_FILE "topology"
+#define SLIDERS_FILE "sliders"
+
+/**
+ * writes the path of the cache directory into buf, returns 0 on success
+ */
+static int cache_dir(char *buf, size_t size)
+{
+	const char *base = getenv("XDG_CACHE_HOME");
+	int len;
+
+	if (base != NULL && base[0] != '\0') {
+		len = snprintf(buf, size, "%s/" TOPOLOGY_DIR, base);
+	} else {
+		const char *home = getenv("HOME");
+		if (home == NULL)
+			return -1;
+		len = snprintf(buf, size, "%s/.cache/" TOPOLOGY_DIR, home);
+	}
+
+	return len > 0 && (size_t) len < size ? 0 : -1;
+}
+
+/**
+ * creates dir and its parent, if they do not exist
+ */
+static int make_dirs(char *dir)
+{
+	char *slash = strrchr(dir, '/');
+
+	if (slash != NULL && slash != dir) {
+		*slash = '\0';
+		int status = mkdir(dir, 0700);
+		*slash = '/';
+		if (status != 0 && errno != EEXIST)
+			return -1;
+	}
+
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+/**
+ * opens a temporary file next to the cache file name, its path goes to tmppath
+ */
+static FILE *begin_write(const char *name, char *path, size_t pathsize, char *tmppath, size_t tmpsize)
+{
+	char dir[512];
+	FILE *file;
+
+	if (cache_dir(dir, sizeof(dir)) != 0 || make_dirs(dir) != 0) {
+		fprintf(stderr, "Error creating cache directory for %s\n", name);
+		return NULL;
+	}
+
+	snprintf(path, pathsize, "%s/%s", dir, name);
+	snprintf(tmppath, tmpsize, "%s.%d", path, (int) getpid());
+
+	/* readers never see a half written file */
+	if ((file = fopen(tmppath, "we")) == NULL)
+		perror("Error writing cache file");
+	return file;
+}
+
+/**
+ * closes the temporary file and puts it in place, returns 0 on success
+ */
+static int end_write(FILE *file, const char *path, const char *tmppath)
+{
+	if (fclose(file) != 0 || rename(tmppath, path) != 0) {
+		perror("Error writing cache file");
+		unlink(tmppath);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * opens a cache file for reading, NULL if there is none
+ */
+static FILE *open_cache_file(const char *name)
+{
+	char dir[512], path[600];
+
+	if (cache_dir(dir, sizeof(dir)) != 0)
+		return NULL;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	return fopen(path, "re");
+}
+
+/**
+ * stores the displays of the last discovery in the cache directory, returns 0 on success
+ */
+int topology_write(const Topology_Entry *entries, int count)
+{
+	char path[600], tmppath[620];
+	FILE *file;
+
+	if ((file = begin_write(TOPOLOGY_FILE, path, sizeof(path), tmppath, sizeof(tmppath))) == NULL)
+		return -1;
+
+	for (int i = 0; i < count; i++)
+		fprintf(file, "%d\t%s\n", entries[i].busno, entries[i].name);
+
+	return end_write(file, path, tmppath);
+}
+
+/**
+ * reads at most max displays of the last discovery, returns their number or -1 if there is no file
+ */
+int topology_read(Topology_Entry *entries, int max)
+{
+	char line[TOPOLOGY_NAME_SIZE + 16];
+	FILE *file;
+	int count = 0;
+
+	if ((file = open_cache_file(TOPOLOGY_FILE)) == NULL)
+		return -1;
+
+	while (count < max && fgets(line, sizeof(line), file) != NULL) {
+		char *tab = strchr(line, '\t');
+		if (tab == NULL)
+			continue;
+
+		entries[count].busno = atoi(line);
+		strncpy(entries[count].name, tab + 1, TOPOLOGY_NAME_SIZE - 1);
+		entries[count].name[TOPOLOGY_NAME_SIZE - 1] = '\0';
+		entries[count].name[strcspn(entries[count].name, "\n")] = '\0';
+		count++;
+	}
+
+	fclose(file);
+	return count;
+}
+
+/**
+ * stores the sliders of the applet in the cache directory, returns 0 on success
+ */
+int topology_write_sliders(const Topology_Slider *sliders, int count)
+{
+	char path[600], tmppath[620];
+	FILE *file;
+
+	if ((file = begin_write(SLIDERS_FILE, path, sizeof(path), tmppath, sizeof(tmppath))) == NULL)
+		return -1;
+
+	for (int i = 0; i < count; i++)
+		fprintf(file, "%u\t%d\t%d\t%s\n", sliders[i].id, sliders[i].minimum, sliders[i].brightness, sliders[i].name);
+
+	return end_write(file, path, tmppath);
+}
+
+/**
+ * reads at most max sliders, returns their number or -1 if there is no file
+ */
+int topology_read_sliders(Topology_Slider *sliders, int max)
+{
+	char line[TOPOLOGY_NAME_SIZE + 48];
+	FILE *file;
+	int count = 0;
+
+	if ((file = open_cache_file(SLIDERS_FILE)) == NULL)
+		return -1;
+
+	while (count < max && fgets(line, sizeof(line), file) != NULL) {
+		Topology_Slider *slider = &sliders[count];
+		int offset;
+
+		/* lines of another version are skipped */
+		if (sscanf(line, "%u\t%d\t%d\t%n", &slider -> id, &slider -> minimum, &slider -> brightness, &offset) != 3)
+			continue;
+
+		strncpy(slider -> name, line + offset, TOPOLOGY_NAME_SIZE - 1);
+		slider -> name[TOPOLOGY_NAME_SIZE - 1] = '\0';
+		slider -> name[strcspn(slider -> name, "\n")] = '\0';
+		count++;
+	}
+
+	fclose(file);
+	return count;
+}
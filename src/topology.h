@@ -0,0 +1,60 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* maximum length of a display name in the topology file (including \0) */
+#define TOPOLOGY_NAME_SIZE 64
+
+/* a display found by the last discovery */
+typedef struct Topology_Entry {
+	int busno;                      /* i2c bus of the display */
+	char name[TOPOLOGY_NAME_SIZE];
+} Topology_Entry;
+
+/* a slider of the applet, shown right away on the next start until discovery confirms it */
+typedef struct Topology_Slider {
+	uint32_t id;                    /* Display_Id, ids stay the same for the same setup */
+	int minimum;                    /* lowest value of the scale */
+	int brightness;                 /* last value confirmed by the monitor or sent to it, as the applet stores it */
+	char name[TOPOLOGY_NAME_SIZE];  /* together with id it identifies the display */
+} Topology_Slider;
+
+/**
+ * stores the displays of the last discovery in the cache directory, returns 0 on success
+ */
+int topology_write(const Topology_Entry *entries, int count);
+
+/**
+ * reads at most max displays of the last discovery, returns their number or -1 if there is no file
+ */
+int topology_read(Topology_Entry *entries, int max);
+
+/**
+ * stores the sliders of the applet in the cache directory, returns 0 on success
+ */
+int topology_write_sliders(const Topology_Slider *sliders, int count);
+
+/**
+ * reads at most max sliders, returns their number or -1 if there is no file
+ */
+int topology_read_sliders(Topology_Slider *sliders, int max);
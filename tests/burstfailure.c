@@ -0,0 +1,95 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * a simulated monitor fails: a short burst is retried with backoff, an outage
+ * opens the circuit breaker, nothing but probes is sent until the monitor
+ * answers again, and the latest wanted brightness is written afterwards
+ */
+
+#include <stddef.h>
+
+#include "ddcwrapper.h"
+#include "fakebackend.h"
+#include "testutil.h"
+
+static Fake_Monitor *monitor;
+static int degraded_events = 0;
+static int healthy_events = 0;
+
+static void state_changed(Display_Id id, int degraded)
+{
+	__atomic_add_fetch(degraded ? &degraded_events : &healthy_events, 1, __ATOMIC_SEQ_CST);
+}
+
+static int has_value(void *value)
+{
+	return __atomic_load_n(&monitor -> current, __ATOMIC_SEQ_CST) == *(int *) value;
+}
+
+static int is_open(void *data)
+{
+	return __atomic_load_n(&degraded_events, __ATOMIC_SEQ_CST) > 0;
+}
+
+int main()
+{
+	int wanted;
+
+	test_tmpdir();
+	fake_init();
+	monitor = fake_add_monitor(0, "Flaky", 0);
+
+	ddc_set_backend(&fake_backend);
+	ddc_register_state_callback(state_changed);
+	CHECK(ddc_count_displays_and_init() == 1, "display not found");
+	Display_Id id = ddc_get_display_id(0);
+
+	/* a short burst is retried until the value is written */
+	monitor -> failures = BREAKER_THRESHOLD - 2;
+	wanted = 30;
+	ddc_set_brightness_percentage(id, wanted, 1);
+	CHECK(test_wait_for(has_value, &wanted, 5000), "brightness is %d after a short burst", monitor -> current);
+	CHECK(monitor -> sets > 1, "the write was not retried");
+	CHECK(degraded_events == 0, "a short burst opened the breaker");
+
+	/* an outage opens the breaker */
+	monitor -> failures = FAKE_OUTAGE;
+	ddc_set_brightness_percentage(id, 70, 2);
+	CHECK(test_wait_for(is_open, NULL, 5000), "breaker did not open");
+	CHECK(ddc_is_degraded(id), "display is not degraded");
+
+	/* while it is open, nothing is written, but the latest value is kept */
+	wanted = 75;
+	ddc_set_brightness_percentage(id, wanted, 3);
+	unsigned long sets = monitor -> sets;
+	test_sleep_ms(1000);
+	CHECK(monitor -> sets == sets, "%lu writes while the breaker was open", monitor -> sets - sets);
+
+	/* the monitor answers again, a probe closes the breaker and the latest value gets written */
+	monitor -> failures = 0;
+	CHECK(test_wait_for(has_value, &wanted, 10000), "brightness is %d after the breaker closed", monitor -> current);
+	CHECK(healthy_events == 1, "display got healthy %d times", healthy_events);
+	CHECK(!ddc_is_degraded(id), "display is still degraded");
+	printf("%lu writes, %lu reads\n", monitor -> sets, monitor -> gets);
+
+	ddc_free();
+	return 0;
+}
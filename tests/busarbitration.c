@@ -0,0 +1,104 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * two processes drive the same simulated monitor at once, like the applet and
+ * a ddcutil script. The flock of the bus has to keep their transactions apart,
+ * the waits show up in the contention counter.
+ */
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ddcwrapper.h"
+#include "fakebackend.h"
+#include "testutil.h"
+
+#define CLIENTS 2
+#define WRITES 200
+
+/* one ddc transaction of the simulated monitor (ms) */
+#define TRANSACTION_MS 5
+
+/* counters of the clients, shared with the parent */
+typedef struct Client_Stats {
+	unsigned long contentions;
+	unsigned long lock_timeouts;
+	int displays;
+} Client_Stats;
+
+/**
+ * one client: discovery, then a write every few ms, waits for the last one
+ */
+static void run_client(int n, Client_Stats *stats)
+{
+	ddc_set_backend(&fake_backend);
+	stats -> displays = ddc_count_displays_and_init();
+	if (stats -> displays != 1)
+		_exit(1);
+	Display_Id id = ddc_get_display_id(0);
+
+	for (int i = 0; i < WRITES; i++) {
+		ddc_set_brightness_percentage(id, (i * 7 + n * 50) % 101, i);
+		test_sleep_ms(TRANSACTION_MS / 2 + n);
+	}
+	test_sleep_ms(500);
+
+	stats -> contentions = ddc_get_bus_contention_count();
+	stats -> lock_timeouts = ddc_get_bus_lock_timeout_count();
+	ddc_free();
+	_exit(0);
+}
+
+int main()
+{
+	pid_t clients[CLIENTS];
+	int status;
+
+	test_tmpdir();
+	fake_init();
+	Fake_Monitor *monitor = fake_add_monitor(0, "Shared", TRANSACTION_MS);
+
+	Client_Stats *stats = mmap(NULL, CLIENTS * sizeof(Client_Stats), PROT_READ | PROT_WRITE,
+	                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	CHECK(stats != MAP_FAILED, "no shared memory");
+
+	for (int n = 0; n < CLIENTS; n++) {
+		clients[n] = fork();
+		CHECK(clients[n] >= 0, "fork failed");
+		if (clients[n] == 0)
+			run_client(n, &stats[n]);
+	}
+
+	unsigned long contentions = 0;
+	for (int n = 0; n < CLIENTS; n++) {
+		waitpid(clients[n], &status, 0);
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "client %d failed, found %d displays", n, stats[n].displays);
+		printf("client %d: %lu contentions, %lu lock timeouts\n", n, stats[n].contentions, stats[n].lock_timeouts);
+		CHECK(stats[n].lock_timeouts == 0, "client %d went on without the lock", n);
+		contentions += stats[n].contentions;
+	}
+	printf("%lu writes, %lu reads, %lu collisions on the bus\n", monitor -> sets, monitor -> gets, fake -> collisions);
+
+	CHECK(fake -> collisions == 0, "%lu transactions collided", fake -> collisions);
+	CHECK(contentions > 0, "the clients never met on the bus");
+	return 0;
+}
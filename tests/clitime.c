@@ -0,0 +1,161 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * times the command line client against an applet, whose brightness service
+ * runs in a child process on the session bus of dbus-run-session
+ * the path of the client is the first argument
+ */
+
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "brightnessservice.h"
+#include "testutil.h"
+
+#define RUNS 20
+
+/* typical invocations have to finish in this time (us) */
+#define MAX_MEDIAN_US 20000
+
+extern char **environ;
+
+static int values[2] = { 50, 70 };
+static const char *names[2] = { "Internal", "Office" };
+
+static void step(int delta)
+{
+}
+
+static int count()
+{
+	return 2;
+}
+
+static const char *get_name(int n)
+{
+	return names[n];
+}
+
+static int get_value(int n)
+{
+	return values[n];
+}
+
+static void set_value(int n, int value)
+{
+	values[n] = value;
+}
+
+static const Service_Callbacks callbacks = { step, count, get_name, get_value, set_value };
+
+/**
+ * runs the applet side until it gets killed
+ */
+static void run_service()
+{
+	service_init(&callbacks);
+	g_main_loop_run(g_main_loop_new(NULL, FALSE));
+}
+
+/**
+ * waits until the service owns its name, returns 1 if it does
+ */
+static int wait_for_service()
+{
+	GDBusConnection *bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	gboolean owned = FALSE;
+
+	for (int i = 0; i < 500 && bus != NULL && !owned; i++) {
+		GVariant *result = g_dbus_connection_call_sync(bus, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+		                                               "org.freedesktop.DBus", "NameHasOwner",
+		                                               g_variant_new("(s)", SERVICE_NAME), G_VARIANT_TYPE("(b)"),
+		                                               G_DBUS_CALL_FLAGS_NONE, 1000, NULL, NULL);
+		if (result != NULL) {
+			g_variant_get(result, "(b)", &owned);
+			g_variant_unref(result);
+		}
+		if (!owned)
+			test_sleep_ms(10);
+	}
+	if (bus != NULL)
+		g_object_unref(bus);
+	return owned;
+}
+
+/**
+ * runs the client RUNS times with args, checks its exit code and prints the times
+ */
+static long measure(char **argv)
+{
+	long samples[RUNS];
+	posix_spawn_file_actions_t actions;
+	pid_t pid;
+	int status;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+
+	for (int i = 0; i < RUNS; i++) {
+		long start = test_now_us();
+		CHECK(posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) == 0, "could not start %s", argv[0]);
+		waitpid(pid, &status, 0);
+		samples[i] = test_now_us() - start;
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "%s %s failed", argv[0], argv[1]);
+	}
+	posix_spawn_file_actions_destroy(&actions);
+
+	long median = test_percentile(samples, RUNS, 50);
+	printf("%-10s p50 %6ld us  max %6ld us\n", argv[1], median, samples[RUNS - 1]);
+	return median;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || getenv("DBUS_SESSION_BUS_ADDRESS") == NULL) {
+		fprintf(stderr, "needs the client as argument and a session bus\n");
+		return TEST_SKIP;
+	}
+
+	pid_t service = fork();
+	if (service == 0) {
+		run_service();
+		_exit(0);
+	}
+	CHECK(wait_for_service(), "service did not appear on the bus");
+
+	char *list[] = { argv[1], "list", NULL };
+	char *get[] = { argv[1], "get", "1", NULL };
+	char *set[] = { argv[1], "set", "1", "40", NULL };
+	long slowest = 0;
+	long times[] = { measure(list), measure(get), measure(set) };
+	for (int i = 0; i < 3; i++)
+		slowest = times[i] > slowest ? times[i] : slowest;
+
+	kill(service, SIGTERM);
+	waitpid(service, NULL, 0);
+
+	CHECK(slowest < MAX_MEDIAN_US, "median of %ld us", slowest);
+	return 0;
+}
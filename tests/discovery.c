@@ -0,0 +1,74 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * discovers simulated monitors with ddcwrapper and changes their brightness,
+ * shows, that brightness-core runs headless without gtk or a display server
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ddcwrapper.h"
+#include "fakebackend.h"
+#include "testutil.h"
+
+static Fake_Monitor *office;
+
+static int is_written(void *data)
+{
+	return __atomic_load_n(&office -> current, __ATOMIC_RELAXED) == 80;
+}
+
+int main()
+{
+	test_tmpdir();
+	fake_init();
+	fake_add_monitor(1, "Second", 0);
+	office = fake_add_monitor(0, "Office", 0);
+	office -> max = 200;
+	office -> current = 100;
+	fake_add_monitor(0, "Docked", 0) -> failures = 100;
+
+	ddc_set_backend(&fake_backend);
+	int count = ddc_count_displays_and_init();
+	CHECK(count == 2, "found %d displays, the failing one must be left out", count);
+
+	/* ids are sorted by dispno, the brightness is a percentage of the maximum */
+	Display_Id id = ddc_get_display_id(1);
+	CHECK(strcmp(ddc_get_display_name(id), "Office") == 0, "second display is %s", ddc_get_display_name(id));
+	CHECK(ddc_get_bus_number(id) == FAKE_BUS_BASE, "bus %d", ddc_get_bus_number(id));
+	CHECK(ddc_get_brightness_percentage(id) == 50, "brightness %d", ddc_get_brightness_percentage(id));
+
+	/* the contrast was read during discovery and is given out without bus traffic */
+	Ddc_Value contrast = { -1, -1 };
+	unsigned long gets = office -> gets;
+	CHECK(ddc_get_snapshot_value(id, CONTRAST_VCP_CODE, &contrast) == 0, "no contrast in the snapshot");
+	CHECK(contrast.current == 75 && contrast.max == 100, "contrast %d of %d", contrast.current, contrast.max);
+	CHECK(office -> gets == gets, "snapshot read the bus");
+
+	ddc_set_brightness_percentage(id, 40, 0);
+	CHECK(test_wait_for(is_written, NULL, 2000), "raw value %d instead of 80", office -> current);
+	CHECK(!ddc_is_degraded(id), "display got degraded");
+
+	ddc_free();
+	CHECK(ddc_get_display_name(id) == NULL, "id is still valid after ddc_free");
+	return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * benchmarks discovery of six monitors, three of them behind one mst hub, where
+ * transactions at the same time garble each other. The old approach started one
+ * probe thread per display at once and relied on retries like ddcutil does,
+ * before that they were probed one after another. ddcwrapper probes one display
+ * per bus at a time with a bounded number of threads, and reads the power mode as well.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "ddcwrapper.h"
+#include "fakebackend.h"
+#include "testutil.h"
+
+/* one ddc transaction of the simulated monitors (ms) */
+#define TRANSACTION_MS 50
+
+/* ddcutil tries a transaction this often */
+#define MAX_TRIES 15
+
+#define MONITORS 6
+
+/**
+ * probe of the old approach: open, read brightness and retry it, until it is not garbled
+ */
+static void *old_probe_thread(void *ref)
+{
+	unsigned int seed = (unsigned int) (intptr_t) ref;
+	void *handle;
+	Ddc_Value value;
+
+	fake_backend.open(ref, &handle);
+	for (int try = 0; try < MAX_TRIES; try++) {
+		if (fake_backend.get(handle, BRIGHTNESS_VCP_CODE, &value) == 0)
+			break;
+		test_sleep_ms(rand_r(&seed) % TRANSACTION_MS);
+	}
+	fake_backend.close(handle);
+	return NULL;
+}
+
+/**
+ * discovers the simulated monitors the old way, all at once or one after another,
+ * returns the wall time in us
+ */
+static long old_discovery(int parallel)
+{
+	Ddc_Backend_Display found[MONITORS];
+	pthread_t threads[MONITORS];
+	int count;
+
+	long start = test_now_us();
+	fake_backend.discover(found, MONITORS, &count);
+	for (int i = 0; i < count; i++) {
+		if (parallel)
+			pthread_create(&threads[i], NULL, old_probe_thread, found[i].ref);
+		else
+			old_probe_thread(found[i].ref);
+	}
+	for (int i = 0; parallel && i < count; i++)
+		pthread_join(threads[i], NULL);
+	return test_now_us() - start;
+}
+
+int main()
+{
+	test_tmpdir();
+	fake_init();
+	fake_add_monitor(0, "Hub 1", TRANSACTION_MS);
+	fake_add_monitor(0, "Hub 2", TRANSACTION_MS);
+	fake_add_monitor(0, "Hub 3", TRANSACTION_MS);
+	fake_add_monitor(1, "Left", TRANSACTION_MS);
+	fake_add_monitor(2, "Right", TRANSACTION_MS);
+	fake_add_monitor(3, "Top", TRANSACTION_MS);
+
+	long sequential_us = old_discovery(0);
+	long old_us = old_discovery(1);
+	unsigned long old_collisions = fake -> collisions;
+	unsigned long old_gets = fake_total(offsetof(Fake_Monitor, gets)) - MONITORS;
+
+	fake -> collisions = 0;
+	unsigned long gets = fake_total(offsetof(Fake_Monitor, gets));
+	ddc_set_backend(&fake_backend);
+	long start = test_now_us();
+	int count = ddc_count_displays_and_init();
+	long new_us = test_now_us() - start;
+	gets = fake_total(offsetof(Fake_Monitor, gets)) - gets;
+
+	printf("one by one    %7ld us, %3d reads,   0 collisions\n", sequential_us, MONITORS);
+	printf("all at once   %7ld us, %3lu reads, %3lu collisions\n", old_us, old_gets, old_collisions);
+	printf("bus aware     %7ld us, %3lu reads, %3lu collisions\n", new_us, gets, fake -> collisions);
+
+	CHECK(count == MONITORS, "found %d of %d displays", count, MONITORS);
+	CHECK(fake -> collisions == 0, "%lu collisions", fake -> collisions);
+	CHECK(new_us < old_us, "bus aware discovery took %ld us, all at once %ld us", new_us, old_us);
+
+	ddc_free();
+	return 0;
+}
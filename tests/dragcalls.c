@@ -0,0 +1,128 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * counts the calls of a fast drag: the slider changes every 2 ms, slidervalue.c
+ * keeps the latest value and sends it once per frame, like the applet does, and
+ * the worker only writes the latest of them, when the monitor is ready again
+ */
+
+#include <stdbool.h>
+
+#include "ddcwrapper.h"
+#include "fakebackend.h"
+#include "slidervalue.h"
+#include "testutil.h"
+
+/* value-changed signals of the slider come in this often while dragging (ms) */
+#define CHANGE_INTERVAL_MS 2
+
+/* a frame of the frame clock at 60 Hz (ms) */
+#define FRAME_MS 16
+
+/* one write to the monitor takes this long (ms) */
+#define WRITE_MS 30
+
+#define DRAG_MS 1500
+
+static Fake_Monitor *monitor;
+static int calls = 0;
+
+static int has_value(void *value)
+{
+	return __atomic_load_n(&monitor -> current, __ATOMIC_SEQ_CST) == *(int *) value;
+}
+
+/**
+ * the backend api, as the applet calls it
+ */
+static void send(Display_Id id, int value, unsigned int trace_id)
+{
+	calls++;
+	ddc_set_brightness_percentage(id, value, trace_id);
+}
+
+int main()
+{
+	Slider_Value outgoing;
+	int changes = 0, frames = 0;
+	bool frame_requested = false;
+
+	test_tmpdir();
+	fake_init();
+	monitor = fake_add_monitor(0, "Drag", WRITE_MS);
+
+	ddc_set_backend(&fake_backend);
+	CHECK(ddc_count_displays_and_init() == 1, "display not found");
+	Display_Id id = ddc_get_display_id(0);
+	slider_value_init(&outgoing);
+
+	/* a display, that the backend does not know yet, keeps its value */
+	CHECK(slider_value_change(&outgoing, 10, 1), "no frame requested");
+	CHECK(!slider_value_flush(&outgoing, id, true, send), "held value was sent");
+	CHECK(slider_value_pending(&outgoing) && calls == 0, "held value was dropped");
+	CHECK(slider_value_flush(&outgoing, id, false, send) && calls == 1, "value was not sent");
+	CHECK(!slider_value_flush(&outgoing, id, false, send) && calls == 1, "value was sent twice");
+	calls = 0;
+
+	unsigned long sets = monitor -> sets;
+	long start = test_now_us();
+	long next_frame = start + FRAME_MS * 1000;
+	for (long now = start; now - start < DRAG_MS * 1000L; now = test_now_us()) {
+		/* value-changed */
+		changes++;
+		if (slider_value_change(&outgoing, (now - start) * 99 / (DRAG_MS * 1000L), changes + 1)) {
+			CHECK(!frame_requested, "a frame was requested twice");
+			frame_requested = true;
+		}
+
+		/* the tick callback only runs, when a frame was requested */
+		if (now >= next_frame) {
+			if (frame_requested) {
+				frame_requested = false;
+				frames++;
+				slider_value_flush(&outgoing, id, false, send);
+			}
+			next_frame += FRAME_MS * 1000;
+		}
+		test_sleep_ms(CHANGE_INTERVAL_MS);
+	}
+
+	/* the value on release goes out at once */
+	int wanted = 100;
+	int before = calls;
+	slider_value_change(&outgoing, wanted, changes + 2);
+	CHECK(slider_value_flush(&outgoing, id, false, send) && calls == before + 1, "release did not flush");
+	CHECK(!slider_value_pending(&outgoing), "a value is left after release");
+	CHECK(test_wait_for(has_value, &wanted, 1000), "brightness is %d after the drag", monitor -> current);
+	sets = monitor -> sets - sets;
+	long elapsed_ms = (test_now_us() - start) / 1000;
+
+	printf("%d changes, %d frames, %d calls of the backend api, %lu writes to the monitor\n", changes, frames, calls, sets);
+
+	/* at most one call per frame and the release, at most one write per write time of the monitor */
+	CHECK(calls <= frames + 1, "%d calls in %d frames", calls, frames);
+	CHECK(frames <= DRAG_MS / FRAME_MS + 1, "%d frames", frames);
+	CHECK(calls > 1, "nothing was sent while dragging");
+	CHECK(sets <= elapsed_ms / WRITE_MS + 1, "%lu writes in %ld ms", sets, elapsed_ms);
+
+	ddc_free();
+	return 0;
+}
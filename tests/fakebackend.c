@@ -0,0 +1,235 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fakebackend.h"
+
+Fake_State *fake = NULL;
+
+/**
+ * sets the fake backend up without monitors
+ */
+void fake_init()
+{
+	fake = mmap(NULL, sizeof(Fake_State), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (fake == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	memset(fake, 0, sizeof(Fake_State));
+
+	strcpy(fake -> dir, "/tmp/fake-buses-XXXXXX");
+	if (mkdtemp(fake -> dir) == NULL) {
+		perror("mkdtemp");
+		exit(1);
+	}
+}
+
+/**
+ * adds a simulated monitor
+ */
+Fake_Monitor *fake_add_monitor(int bus, const char *name, int delay_ms)
+{
+	Fake_Monitor *monitor = &fake -> monitors[fake -> count++];
+	monitor -> busno = FAKE_BUS_BASE + bus;
+	snprintf(monitor -> name, sizeof(monitor -> name), "%s", name);
+	monitor -> max = 100;
+	monitor -> current = 50;
+	monitor -> contrast = 75;
+	monitor -> delay_ms = delay_ms;
+	return monitor;
+}
+
+/**
+ * sum of a counter over all monitors
+ */
+unsigned long fake_total(size_t counter)
+{
+	unsigned long total = 0;
+	for (int i = 0; i < fake -> count; i++)
+		total += __atomic_load_n((unsigned long *) ((char *) &fake -> monitors[i] + counter), __ATOMIC_RELAXED);
+	return total;
+}
+
+/**
+ * one transaction on the bus of the monitor, it takes delay_ms
+ * returns false, if another one ran on the bus meanwhile, like garbled answers on a real bus
+ */
+static bool transaction(Fake_Monitor *monitor)
+{
+	int *busy = &fake -> busy[(monitor -> busno - FAKE_BUS_BASE) % FAKE_MAX_MONITORS];
+	bool alone = __atomic_fetch_add(busy, 1, __ATOMIC_SEQ_CST) == 0;
+
+	long ms = monitor -> delay_ms;
+	struct timespec ts = { ms / 1000, ms % 1000 * 1000000L };
+	while (nanosleep(&ts, &ts) != 0)
+		;
+
+	/* a transaction, that started meanwhile, garbles this one as well */
+	alone = __atomic_sub_fetch(busy, 1, __ATOMIC_SEQ_CST) == 0 && alone;
+	if (!alone)
+		__atomic_add_fetch(&fake -> collisions, 1, __ATOMIC_RELAXED);
+	return alone;
+}
+
+/**
+ * tells, if the next operation fails on purpose
+ */
+static bool take_failure(Fake_Monitor *monitor)
+{
+	int left = __atomic_load_n(&monitor -> failures, __ATOMIC_RELAXED);
+	if (left == FAKE_OUTAGE)
+		return true;
+	while (left > 0) {
+		if (__atomic_compare_exchange_n(&monitor -> failures, &left, left - 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			return true;
+	}
+	return false;
+}
+
+static int fake_discover(Ddc_Backend_Display *displays, int max, int *count)
+{
+	*count = 0;
+	for (int i = 0; i < fake -> count && i < max; i++) {
+		Fake_Monitor *monitor = &fake -> monitors[i];
+		displays[i].dispno = i + 1;
+		displays[i].busno = monitor -> busno;
+		displays[i].name = monitor -> name;
+		displays[i].identity = ddc_hash(monitor -> name, strlen(monitor -> name), DDC_HASH_INIT);
+		displays[i].ref = monitor;
+		(*count)++;
+	}
+	return 0;
+}
+
+static int fake_open(void *ref, void **handle)
+{
+	Fake_Monitor *monitor = ref;
+	__atomic_add_fetch(&monitor -> opens, 1, __ATOMIC_RELAXED);
+	*handle = monitor;
+	return 0;
+}
+
+static int fake_close(void *handle)
+{
+	return 0;
+}
+
+static int fake_get(void *handle, int vcp_code, Ddc_Value *value)
+{
+	Fake_Monitor *monitor = handle;
+	__atomic_add_fetch(&monitor -> gets, 1, __ATOMIC_RELAXED);
+
+	bool garbled = !transaction(monitor);
+	if (take_failure(monitor))
+		return FAKE_ERROR_FAILED;
+	if (garbled)
+		return FAKE_ERROR_COLLISION;
+
+	if (vcp_code == BRIGHTNESS_VCP_CODE) {
+		value -> current = __atomic_load_n(&monitor -> current, __ATOMIC_RELAXED);
+		value -> max = monitor -> max;
+		return 0;
+	}
+	if (vcp_code == CONTRAST_VCP_CODE) {
+		value -> current = monitor -> contrast;
+		value -> max = 100;
+		return 0;
+	}
+	return FAKE_ERROR_UNSUPPORTED;
+}
+
+static int fake_set(void *handle, int vcp_code, int value)
+{
+	Fake_Monitor *monitor = handle;
+	__atomic_add_fetch(&monitor -> sets, 1, __ATOMIC_RELAXED);
+
+	bool garbled = !transaction(monitor);
+	if (take_failure(monitor))
+		return FAKE_ERROR_FAILED;
+	if (garbled)
+		return FAKE_ERROR_COLLISION;
+
+	if (vcp_code != BRIGHTNESS_VCP_CODE)
+		return FAKE_ERROR_UNSUPPORTED;
+	__atomic_store_n(&monitor -> current, value, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static const char *fake_describe(int rc)
+{
+	switch (rc) {
+	case FAKE_ERROR_FAILED:
+		return "simulated failure";
+	case FAKE_ERROR_COLLISION:
+		return "collision on the simulated bus";
+	case FAKE_ERROR_UNSUPPORTED:
+		return "unsupported vcp code";
+	default:
+		return "unknown error";
+	}
+}
+
+static int fake_is_transient(int rc)
+{
+	return rc == FAKE_ERROR_FAILED || rc == FAKE_ERROR_COLLISION;
+}
+
+static int fake_arbitrates_buses()
+{
+	return 0;
+}
+
+/**
+ * every simulated bus has a file, that stands in for /dev/i2c-N
+ */
+static void fake_bus_device(int busno, char *path, size_t size)
+{
+	snprintf(path, size, "%s/i2c-%d", fake -> dir, busno);
+	int fd = open(path, O_RDONLY | O_CREAT | O_CLOEXEC, 0600);
+	if (fd >= 0)
+		close(fd);
+}
+
+static void fake_free()
+{
+}
+
+const Ddc_Backend fake_backend = {
+	.discover = fake_discover,
+	.open = fake_open,
+	.close = fake_close,
+	.get = fake_get,
+	.set = fake_set,
+	.describe = fake_describe,
+	.is_transient = fake_is_transient,
+	.arbitrates_buses = fake_arbitrates_buses,
+	.bus_device = fake_bus_device,
+	.free = fake_free
+};
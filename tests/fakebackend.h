@@ -0,0 +1,86 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include "ddcbackend.h"
+#include "displayid.h"
+
+/* errors of the fake backend */
+#define FAKE_ERROR_FAILED -3001         /* simulated failure of a monitor, transient */
+#define FAKE_ERROR_COLLISION -3002      /* another transaction was on the bus at the same time, transient */
+#define FAKE_ERROR_UNSUPPORTED -3003    /* the monitor does not know the vcp code */
+
+#define FAKE_MAX_MONITORS MAX_DDC_DISPLAYS
+
+/* buses of simulated monitors start here, so no connector of the machine matches them */
+#define FAKE_BUS_BASE 900
+
+/* failures of a monitor, that does not answer until the test sets failures to 0 */
+#define FAKE_OUTAGE -1
+
+/* a simulated monitor, all fields may be changed by the test while it runs */
+typedef struct Fake_Monitor {
+	int busno;              /* monitors on one bus sit behind one mst hub */
+	char name[32];
+	int max;                /* maximum of the brightness */
+	int current;            /* raw brightness */
+	int contrast;           /* raw contrast, its maximum is 100 */
+	int delay_ms;           /* every get and set takes this long */
+	int failures;           /* this many of the next gets and sets fail, all of them with FAKE_OUTAGE */
+	unsigned long opens;
+	unsigned long gets;
+	unsigned long sets;
+} Fake_Monitor;
+
+/* everything the fake backend knows, it is shared with forked processes */
+typedef struct Fake_State {
+	Fake_Monitor monitors[FAKE_MAX_MONITORS];
+	int count;
+	int busy[FAKE_MAX_MONITORS];    /* running transactions by bus, index is busno - FAKE_BUS_BASE */
+	unsigned long collisions;       /* transactions, that met another one on their bus */
+	char dir[32];                   /* the files, that ddcwrapper flocks for the buses, are in here */
+} Fake_State;
+
+/**
+ * the state of the fake backend, valid after fake_init
+ */
+extern Fake_State *fake;
+
+/**
+ * sets the fake backend up without monitors, forked processes share its state
+ * and flock the same files for the buses
+ */
+void fake_init();
+
+/**
+ * adds a simulated monitor on bus FAKE_BUS_BASE + bus, brightness 50 of 100
+ */
+Fake_Monitor *fake_add_monitor(int bus, const char *name, int delay_ms);
+
+/**
+ * sum of a counter over all monitors, like offsetof(Fake_Monitor, sets)
+ */
+unsigned long fake_total(size_t counter);
+
+/**
+ * backend, that talks to the simulated monitors
+ */
+extern const Ddc_Backend fake_backend;
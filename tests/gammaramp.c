@@ -0,0 +1,137 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * dims an output of Xvfb through its gamma ramp: the ramp is scaled from the
+ * current one, a ramp set by someone else meanwhile (like Night Light) becomes
+ * the new base, searching the outputs again keeps the dimming, and gamma_destroy
+ * leaves the new base in place
+ */
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gammadisplayhandler.h"
+#include "testutil.h"
+
+/* scale of level 50, see GAMMA_MIN_PERMILLE in gammadisplayhandler.c */
+#define HALF_FACTOR ((200 + 800 * 50 / 100) * 65536 / 1000)
+
+static Display *xdisplay;
+
+/**
+ * finds the crtc of the output, that gammadisplayhandler calls name
+ */
+static RRCrtc find_crtc(const char *name)
+{
+	RRCrtc crtc = None;
+	XRRScreenResources *res = XRRGetScreenResourcesCurrent(xdisplay, DefaultRootWindow(xdisplay));
+
+	for (int i = 0; res != NULL && i < res -> noutput && crtc == None; i++) {
+		XRROutputInfo *info = XRRGetOutputInfo(xdisplay, res, res -> outputs[i]);
+		if (info != NULL && strcmp(info -> name, name) == 0)
+			crtc = info -> crtc;
+		if (info != NULL)
+			XRRFreeOutputInfo(info);
+	}
+	if (res != NULL)
+		XRRFreeScreenResources(res);
+	return crtc;
+}
+
+/**
+ * checks, that every entry of ramp is the one of base scaled by factor
+ */
+static void check_scaled(XRRCrtcGamma *ramp, XRRCrtcGamma *base, uint32_t factor, const char *what)
+{
+	CHECK(ramp -> size == base -> size, "%s: ramp has %d entries instead of %d", what, ramp -> size, base -> size);
+	for (int i = 0; i < ramp -> size; i++) {
+		CHECK(ramp -> red[i] == (base -> red[i] * factor >> 16) &&
+		      ramp -> green[i] == (base -> green[i] * factor >> 16) &&
+		      ramp -> blue[i] == (base -> blue[i] * factor >> 16),
+		      "%s: entry %d is %u instead of %u", what, i, ramp -> red[i], base -> red[i] * factor >> 16);
+	}
+}
+
+int main()
+{
+	char name[GAMMA_NAME_SIZE];
+
+	if (getenv("DISPLAY") == NULL || (xdisplay = XOpenDisplay(NULL)) == NULL) {
+		fprintf(stderr, "no X server, run it with xvfb-run\n");
+		return TEST_SKIP;
+	}
+	if (gamma_init() == 0) {
+		fprintf(stderr, "the X server has no output with a gamma ramp\n");
+		return TEST_SKIP;
+	}
+
+	CHECK(gamma_get_name(0, name, sizeof(name)) == 0, "first slot is free");
+	RRCrtc crtc = find_crtc(name);
+	CHECK(crtc != None, "no crtc for %s", name);
+	XRRCrtcGamma *original = XRRGetCrtcGamma(xdisplay, crtc);
+	CHECK(gamma_get_brightness(0) == 100, "output starts dimmed at %d", gamma_get_brightness(0));
+
+	/* dimming scales the ramp, that was there */
+	gamma_set_brightness(0, 50);
+	XRRCrtcGamma *ramp = XRRGetCrtcGamma(xdisplay, crtc);
+	check_scaled(ramp, original, HALF_FACTOR, "dimmed");
+	XRRFreeGamma(ramp);
+
+	/* someone else sets a warmer ramp, it is the new undimmed one */
+	XRRCrtcGamma *warm = XRRAllocGamma(original -> size);
+	for (int i = 0; i < warm -> size; i++) {
+		warm -> red[i] = original -> red[i];
+		warm -> green[i] = original -> green[i] * 3 / 4;
+		warm -> blue[i] = original -> blue[i] / 2;
+	}
+	XRRSetCrtcGamma(xdisplay, crtc, warm);
+	XSync(xdisplay, False);
+	CHECK(gamma_get_brightness(0) == 100, "a replaced ramp still counts as dimmed to %d", gamma_get_brightness(0));
+
+	gamma_set_brightness(0, 50);
+	ramp = XRRGetCrtcGamma(xdisplay, crtc);
+	check_scaled(ramp, warm, HALF_FACTOR, "dimmed warm");
+	XRRFreeGamma(ramp);
+
+	/* an output, that stays, keeps its slot and dimming, when they are searched again */
+	uint32_t identity = gamma_get_identity(0);
+	CHECK(gamma_rescan() > 0, "output is gone after searching again");
+	CHECK(gamma_get_identity(0) == identity, "output moved to another slot");
+	CHECK(gamma_get_brightness(0) == 50, "output is at %d after searching again", gamma_get_brightness(0));
+	ramp = XRRGetCrtcGamma(xdisplay, crtc);
+	check_scaled(ramp, warm, HALF_FACTOR, "searched again");
+	XRRFreeGamma(ramp);
+
+	/* the warm ramp stays after the handler is gone */
+	gamma_destroy();
+	ramp = XRRGetCrtcGamma(xdisplay, crtc);
+	check_scaled(ramp, warm, 65536, "restored");
+	XRRFreeGamma(ramp);
+
+	XRRSetCrtcGamma(xdisplay, crtc, original);
+	XRRFreeGamma(warm);
+	XRRFreeGamma(original);
+	XCloseDisplay(xdisplay);
+	return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * measures, what discovery costs the panel process: libddcutil must only be
+ * mapped into the helper, the panel side only grows by the helper client
+ * prints the resident memory of both and the time to start the helper
+ */
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ddctrace.h"
+#include "helperclient.h"
+#include "testutil.h"
+
+/* the panel process may grow this much by discovery (kB) */
+#define MAX_PANEL_GROWTH_KB 4096
+
+/**
+ * returns VmRSS of a process in kB, -1 if it is unknown
+ */
+static long rss_kb(pid_t pid)
+{
+	char path[64], line[128];
+	long rss = -1;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), file) != NULL)
+		if (strncmp(line, "VmRSS:", 6) == 0)
+			rss = strtol(line + 6, NULL, 10);
+	fclose(file);
+	return rss;
+}
+
+/**
+ * tells, if a library with name in its path is mapped into a process
+ */
+static int maps_library(pid_t pid, const char *name)
+{
+	char path[64], line[512];
+	int found = 0;
+
+	snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return 0;
+	while (!found && fgets(line, sizeof(line), file) != NULL)
+		found = strstr(line, name) != NULL;
+	fclose(file);
+	return found;
+}
+
+/**
+ * finds the helper, the only child of this process, -1 if there is none
+ */
+static pid_t find_helper()
+{
+	DIR *proc = opendir("/proc");
+	struct dirent *entry;
+	pid_t helper = -1;
+	char path[64];
+
+	while (helper < 0 && proc != NULL && (entry = readdir(proc)) != NULL) {
+		int pid = atoi(entry -> d_name);
+		int ppid = 0;
+		if (pid <= 0)
+			continue;
+		snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+		FILE *file = fopen(path, "r");
+		if (file == NULL)
+			continue;
+		if (fscanf(file, "%*d (%*[^)]) %*c %d", &ppid) == 1 && ppid == getpid())
+			helper = pid;
+		fclose(file);
+	}
+	if (proc != NULL)
+		closedir(proc);
+	return helper;
+}
+
+int main()
+{
+	if (getenv(HELPER_PATH_ENV) == NULL) {
+		fprintf(stderr, "%s is not set\n", HELPER_PATH_ENV);
+		return TEST_SKIP;
+	}
+	setenv(TRACE_REPLAY_ENV, test_write_trace(2, 0), 1);
+
+	long before = rss_kb(getpid());
+	long start = test_now_us();
+	int count = helper_count_displays_and_init();
+	long start_us = test_now_us() - start;
+	CHECK(count == 2, "helper found %d displays", count);
+	long after = rss_kb(getpid());
+
+	pid_t helper = find_helper();
+	CHECK(helper > 0, "helper process not found");
+
+	printf("helper started and discovered in %ld us\n", start_us);
+	printf("panel side   %6ld kB, grew by %ld kB, libddcutil %s\n", after, after - before,
+	       maps_library(getpid(), "libddcutil") ? "mapped" : "not mapped");
+	printf("helper       %6ld kB, libddcutil %s\n", rss_kb(helper),
+	       maps_library(helper, "libddcutil") ? "mapped" : "not mapped");
+
+	CHECK(!maps_library(getpid(), "libddcutil"), "libddcutil is mapped into the panel side");
+	CHECK(after - before < MAX_PANEL_GROWTH_KB, "panel side grew by %ld kB", after - before);
+
+	helper_free();
+	return 0;
+}
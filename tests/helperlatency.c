@@ -0,0 +1,93 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * benchmarks the hop between applet and helper: a brightness, that both sides
+ * answer from their cache, is read once through the socket and once in the process
+ */
+
+#include <stdlib.h>
+
+#include "ddctrace.h"
+#include "ddcwrapper.h"
+#include "fakebackend.h"
+#include "helperclient.h"
+#include "testutil.h"
+
+#define ROUNDS 2000
+#define WARMUP 100
+
+/* a hop, that costs more than this, would be noticed while dragging a slider (us) */
+#define MAX_HOP_P99_US 5000
+
+static long samples[ROUNDS];
+
+/**
+ * reads the brightness ROUNDS times, prints and returns the median in us
+ */
+static long measure(const char *what, int (*read)(Display_Id), Display_Id id, long *p99)
+{
+	for (int i = 0; i < WARMUP; i++)
+		read(id);
+
+	for (int i = 0; i < ROUNDS; i++) {
+		long start = test_now_us();
+		int value = read(id);
+		samples[i] = test_now_us() - start;
+		CHECK(value == 50, "%s read %d", what, value);
+	}
+
+	long median = test_percentile(samples, ROUNDS, 50);
+	*p99 = test_percentile(samples, ROUNDS, 99);
+	printf("%-10s p50 %5ld us  p99 %5ld us\n", what, median, *p99);
+	return median;
+}
+
+int main()
+{
+	long helper_p99, local_p99;
+
+	if (getenv(HELPER_PATH_ENV) == NULL) {
+		fprintf(stderr, "%s is not set\n", HELPER_PATH_ENV);
+		return TEST_SKIP;
+	}
+
+	/* the helper replays a monitor, the process talks to a simulated one */
+	setenv(TRACE_REPLAY_ENV, test_write_trace(1, 0), 1);
+	int count = helper_count_displays_and_init();
+	CHECK(count == 1, "helper found %d displays", count);
+	unsetenv(TRACE_REPLAY_ENV);
+
+	fake_init();
+	fake_add_monitor(0, "Local", 0);
+	ddc_set_backend(&fake_backend);
+	count = ddc_count_displays_and_init();
+	CHECK(count == 1, "found %d displays", count);
+
+	long helper = measure("helper", helper_get_brightness_percentage, helper_get_display_id(0), &helper_p99);
+	long local = measure("in process", ddc_get_brightness_percentage, ddc_get_display_id(0), &local_p99);
+	printf("hop        p50 %5ld us\n", helper - local);
+
+	CHECK(helper_p99 < MAX_HOP_P99_US, "p99 of the hop is %ld us", helper_p99);
+
+	helper_free();
+	ddc_free();
+	return 0;
+}
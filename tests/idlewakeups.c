@@ -0,0 +1,99 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * counts the wakeups of the ddcwrapper threads while nobody asks for anything:
+ * a healthy monitor and one, that stopped answering, must not cost a single one,
+ * once the quiet period is over (built with IDLE_AFTER_MS of one second)
+ * the next request has to be written within one round trip
+ */
+
+#include <stddef.h>
+
+#include "ddcwrapper.h"
+#include "fakebackend.h"
+#include "testutil.h"
+
+/* quiet period, that this test is built with (ms) */
+#define IDLE_MS 1000
+
+/* a degraded display is probed in this interval, see ddcwrapper.c (ms) */
+#define HEALTH_PROBE_INTERVAL_MS 5000
+
+/* one ddc transaction of the simulated monitors (ms) */
+#define TRANSACTION_MS 20
+
+#define IDLE_WINDOW_MS 3000
+
+static Fake_Monitor *healthy;
+
+static int has_value(void *value)
+{
+	return __atomic_load_n(&healthy -> current, __ATOMIC_SEQ_CST) == *(int *) value;
+}
+
+static int is_degraded(void *id)
+{
+	return ddc_is_degraded(*(Display_Id *) id);
+}
+
+int main()
+{
+	test_tmpdir();
+	fake_init();
+	healthy = fake_add_monitor(0, "Healthy", TRANSACTION_MS);
+	Fake_Monitor *broken = fake_add_monitor(1, "Broken", TRANSACTION_MS);
+
+	ddc_set_backend(&fake_backend);
+	CHECK(ddc_count_displays_and_init() == 2, "displays not found");
+	Display_Id healthy_id = ddc_get_display_id(0);
+	Display_Id broken_id = ddc_get_display_id(1);
+
+	/* one monitor gets written, the other one stops answering */
+	int wanted = 30;
+	ddc_set_brightness_percentage(healthy_id, wanted, 1);
+	broken -> failures = 1000000;
+	ddc_set_brightness_percentage(broken_id, 30, 2);
+	CHECK(test_wait_for(has_value, &wanted, 1000), "brightness was not written");
+	CHECK(test_wait_for(is_degraded, &broken_id, 10000), "broken monitor did not get degraded");
+
+	/* after the quiet period the last probe of the broken monitor runs, then everything stands still */
+	test_sleep_ms(IDLE_MS + HEALTH_PROBE_INTERVAL_MS + 1000);
+	unsigned long before = ddc_get_wakeup_count();
+	unsigned long ops = fake_total(offsetof(Fake_Monitor, gets)) + fake_total(offsetof(Fake_Monitor, opens));
+	test_sleep_ms(IDLE_WINDOW_MS);
+	unsigned long wakeups = ddc_get_wakeup_count() - before;
+	ops = fake_total(offsetof(Fake_Monitor, gets)) + fake_total(offsetof(Fake_Monitor, opens)) - ops;
+	printf("%lu wakeups and %lu operations in %d ms of idle\n", wakeups, ops, IDLE_WINDOW_MS);
+	CHECK(wakeups == 0, "%lu wakeups while idle", wakeups);
+	CHECK(ops == 0, "%lu operations while idle", ops);
+
+	/* the next request resumes at once */
+	wanted = 60;
+	long start = test_now_us();
+	ddc_set_brightness_percentage(healthy_id, wanted, 3);
+	CHECK(test_wait_for(has_value, &wanted, 1000), "brightness was not written after idle");
+	long resume_us = test_now_us() - start;
+	printf("written %ld us after idle\n", resume_us);
+	CHECK(resume_us < 3 * TRANSACTION_MS * 1000, "writing after idle took %ld us", resume_us);
+
+	ddc_free();
+	return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * benchmarks reads of the user on a bus, that is busy with background reads of
+ * two other monitors behind the same hub, built with the value cache off, so
+ * every read goes to the bus. User requests must only wait for the transaction,
+ * that is already running, and the gap before the bus is locked again, not for
+ * the queued background ones.
+ */
+
+#include <pthread.h>
+
+#include "ddcwrapper.h"
+#include "fakebackend.h"
+#include "testutil.h"
+
+/* every ddc transaction of the simulated monitors takes this long (ms) */
+#define TRANSACTION_MS 30
+
+/* sleeping threads wake up this much later on a busy machine, it is far below a queued transaction (ms) */
+#define SCHEDULING_SLACK_MS 15
+
+#define SAMPLES 200
+#define BACKGROUND_THREADS 4
+
+static long samples[SAMPLES];
+static int running = 1;
+static unsigned long background_done = 0;
+static unsigned long background_dropped = 0;
+
+/**
+ * reads the brightness of a background monitor again and again
+ */
+static void *background_thread(void *val)
+{
+	Display_Id id = ddc_get_display_id(1 + (int) (intptr_t) val % 2);
+	while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+		if (ddc_prefetch_brightness_percentage(id) >= 0)
+			__atomic_add_fetch(&background_done, 1, __ATOMIC_RELAXED);
+		else
+			__atomic_add_fetch(&background_dropped, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/**
+ * reads the monitor of the user SAMPLES times, returns the p99 in us
+ */
+static long measure(const char *what, Display_Id id)
+{
+	for (int i = 0; i < SAMPLES; i++) {
+		long start = test_now_us();
+		int value = ddc_get_brightness_percentage(id);
+		samples[i] = test_now_us() - start;
+		CHECK(value == 50, "read %d", value);
+		test_sleep_ms(2);
+	}
+
+	long p99 = test_percentile(samples, SAMPLES, 99);
+	printf("%-16s p50 %6ld us  p99 %6ld us\n", what, test_percentile(samples, SAMPLES, 50), p99);
+	return p99;
+}
+
+int main()
+{
+	pthread_t threads[BACKGROUND_THREADS];
+
+	test_tmpdir();
+	fake_init();
+	fake_add_monitor(0, "User", TRANSACTION_MS);
+	fake_add_monitor(0, "Background 1", TRANSACTION_MS);
+	fake_add_monitor(0, "Background 2", TRANSACTION_MS);
+
+	ddc_set_backend(&fake_backend);
+	CHECK(ddc_count_displays_and_init() == 3, "displays not found");
+	Display_Id id = ddc_get_display_id(0);
+
+	long idle = measure("idle bus", id);
+
+	for (int i = 0; i < BACKGROUND_THREADS; i++)
+		pthread_create(&threads[i], NULL, background_thread, (void *) (intptr_t) i);
+	test_sleep_ms(100);
+	long loaded = measure("background load", id);
+	__atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+	for (int i = 0; i < BACKGROUND_THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	printf("background reads: %lu done, %lu dropped for the user\n", background_done, background_dropped);
+	CHECK(background_done > 0, "no background read got through");
+	CHECK(fake -> collisions == 0, "%lu collisions on the bus", fake -> collisions);
+
+	/* the running background transaction is waited for, not the ones of all BACKGROUND_THREADS */
+	CHECK(loaded <= idle + (TRANSACTION_MS + BUS_LOCK_GAP_MS + SCHEDULING_SLACK_MS) * 1000,
+	      "p99 of %ld us under load, %ld us idle", loaded, idle);
+
+	ddc_free();
+	return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * measures what lazy discovery leaves for startup, reading the sliders of the last
+ * session from the cache, and the time from the first click to usable sliders,
+ * which starts the helper, discovers the monitors and reads their brightness
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ddctrace.h"
+#include "helperclient.h"
+#include "testutil.h"
+#include "topology.h"
+
+#define DISPLAYS 2
+
+/* a ddc read or write of a usual monitor takes about this long (us) */
+#define MONITOR_LATENCY_US 40000
+
+/* the panel must not wait this long for cached sliders (us) */
+#define MAX_RESTORE_US 5000
+
+/* sliders must be usable this long after the first click (us) */
+#define MAX_FIRST_CLICK_US 2000000
+
+int main()
+{
+	Topology_Slider sliders[DISPLAYS];
+	long start;
+
+	if (getenv(HELPER_PATH_ENV) == NULL) {
+		fprintf(stderr, "%s is not set\n", HELPER_PATH_ENV);
+		return TEST_SKIP;
+	}
+	setenv(TRACE_REPLAY_ENV, test_write_trace(DISPLAYS, MONITOR_LATENCY_US), 1);
+
+	/* startup only shows the sliders of the last session */
+	memset(sliders, 0, sizeof(sliders));
+	for (int i = 0; i < DISPLAYS; i++) {
+		sliders[i].id = i + 1;
+		sliders[i].brightness = 50;
+		snprintf(sliders[i].name, sizeof(sliders[i].name), "Replay %d", i + 1);
+	}
+	CHECK(topology_write_sliders(sliders, DISPLAYS) == 0, "could not write the sliders");
+
+	start = test_now_us();
+	int restored = topology_read_sliders(sliders, DISPLAYS);
+	long restore_us = test_now_us() - start;
+	CHECK(restored == DISPLAYS, "restored %d sliders", restored);
+
+	/* the first click starts everything */
+	start = test_now_us();
+	int count = helper_count_displays_and_init();
+	long discovered_us = test_now_us() - start;
+	CHECK(count == DISPLAYS, "helper found %d displays", count);
+	for (int i = 0; i < count; i++) {
+		int value = helper_get_brightness_percentage(helper_get_display_id(i));
+		CHECK(value == 50, "display %d has brightness %d", i, value);
+	}
+	long usable_us = test_now_us() - start;
+
+	printf("restore cached sliders  %7ld us\n", restore_us);
+	printf("helper and discovery    %7ld us\n", discovered_us);
+	printf("first click to sliders  %7ld us\n", usable_us);
+
+	CHECK(restore_us < MAX_RESTORE_US, "restoring sliders took %ld us", restore_us);
+	CHECK(usable_us < MAX_FIRST_CLICK_US, "sliders were usable after %ld us", usable_us);
+
+	helper_free();
+	return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ddctrace.h"
+#include "testutil.h"
+
+/**
+ * microseconds on the monotonic clock
+ */
+long test_now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+/**
+ * sleeps ms milliseconds
+ */
+void test_sleep_ms(long ms)
+{
+	struct timespec ts = { ms / 1000, ms % 1000 * 1000000L };
+	while (nanosleep(&ts, &ts) != 0)
+		;
+}
+
+/**
+ * waits up to timeout_ms for cond to return true
+ */
+int test_wait_for(int (*cond)(void *), void *data, long timeout_ms)
+{
+	long deadline = test_now_us() + timeout_ms * 1000;
+	while (!cond(data)) {
+		if (test_now_us() >= deadline)
+			return 0;
+		test_sleep_ms(5);
+	}
+	return 1;
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *) a, y = *(const long *) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * returns the value below which percent of the count samples lie
+ */
+long test_percentile(long *samples, int count, int percent)
+{
+	if (count <= 0)
+		return 0;
+	qsort(samples, count, sizeof(long), cmp_long);
+	int i = (count * percent + 99) / 100 - 1;
+	return samples[i < 0 ? 0 : i];
+}
+
+/**
+ * makes a temporary directory and points XDG_CACHE_HOME at it
+ */
+const char *test_tmpdir()
+{
+	static char dir[64] = "";
+
+	if (dir[0] == '\0') {
+		strcpy(dir, "/tmp/brightness-test-XXXXXX");
+		if (mkdtemp(dir) == NULL) {
+			perror("mkdtemp");
+			exit(1);
+		}
+		setenv("XDG_CACHE_HOME", dir, 1);
+	}
+	return dir;
+}
+
+/**
+ * writes a trace of count displays with brightness 50 of 100
+ */
+const char *test_write_trace(int count, long latency_us)
+{
+	static char path[96];
+	char name[32];
+
+	snprintf(path, sizeof(path), "%s/replay-%d-%ld.trace", test_tmpdir(), count, latency_us);
+	remove(path);
+	if (trace_record_open(path) != 0)
+		exit(1);
+
+	for (int i = 1; i <= count; i++) {
+		snprintf(name, sizeof(name), "Replay %d", i);
+		trace_record_display(i, name);
+		trace_record(TRACE_OP_OPEN, i, 0, 0, 0, 0, 0, 0);
+		trace_record(TRACE_OP_GET, i, BRIGHTNESS_VCP_CODE, 50, 100, 0, 0, latency_us);
+		trace_record(TRACE_OP_SET, i, BRIGHTNESS_VCP_CODE, 50, 0, 0, 0, latency_us);
+		trace_record(TRACE_OP_CLOSE, i, 0, 0, 0, 0, 0, 0);
+	}
+	trace_close();
+	return path;
+}
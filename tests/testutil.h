@@ -0,0 +1,71 @@
+/**
+ * This file is part of budgie-monitor-brightness-applet
+ *
+ * Copyright © 2019 Dominik Schütz <do.sch.dev@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program;  if not, write to the Free Software Foundation, Inc., 
+ * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* exit code, that tells meson, that a test could not run here */
+#define TEST_SKIP 77
+
+/* ends the test as failed, if cond does not hold */
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		exit(1); \
+	} \
+} while (0)
+
+/**
+ * microseconds on the monotonic clock
+ */
+long test_now_us();
+
+/**
+ * sleeps ms milliseconds
+ */
+void test_sleep_ms(long ms);
+
+/**
+ * waits up to timeout_ms for cond to return true, polling every few ms
+ * returns 1 if it did
+ */
+int test_wait_for(int (*cond)(void *), void *data, long timeout_ms);
+
+/**
+ * returns the value below which percent of the count samples lie, sorts samples
+ */
+long test_percentile(long *samples, int count, int percent);
+
+/**
+ * writes a trace (see ddctrace.h) of count displays into the temporary directory,
+ * every operation of them takes latency_us, returns its path
+ * the helper replays it instead of talking to monitors, when TRACE_REPLAY_ENV points at it
+ */
+const char *test_write_trace(int count, long latency_us);
+
+/**
+ * makes a temporary directory for files of the test and points XDG_CACHE_HOME at it,
+ * so nothing of the user is touched, returns its path
+ */
+const char *test_tmpdir();